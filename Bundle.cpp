@@ -0,0 +1,87 @@
+#include "Bundle.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <stdexcept>
+
+uint64_t bundle_hash(unsigned char const *data, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+Bundle::Bundle(std::string const &filename_) : filename(filename_) {
+	file.reset(new MappedFile(filename));
+
+	//read the chunks in place, checking each fits in the file:
+	ChunkReader reader(file->data, file->size, filename);
+
+	ChunkView< BundleHeader > headers = reader.view< BundleHeader >("bdl0");
+	if (headers.size != 1) {
+		throw std::runtime_error("Bundle '" + filename + "' has an unexpected header size.");
+	}
+	BundleHeader const &header = headers[0];
+	if (header.version != 1) {
+		throw std::runtime_error("Bundle '" + filename + "' is version " + std::to_string(header.version) + " (expecting 1).");
+	}
+
+	ChunkView< char > strings = reader.view< char >("str0");
+
+	//(the table of contents follows the names, so may not be aligned for BundleEntry -- if not, it is copied)
+	std::vector< BundleEntry > entries_copy;
+	ChunkView< BundleEntry > entries = reader.read< BundleEntry >("toc0", &entries_copy);
+	if (entries.size != header.count) {
+		throw std::runtime_error("Bundle '" + filename + "' should list " + std::to_string(header.count) + " files, but its table of contents has " + std::to_string(entries.size) + ".");
+	}
+	if (bundle_hash(reinterpret_cast< unsigned char const * >(entries.data), entries.size * sizeof(BundleEntry), bundle_hash(reinterpret_cast< unsigned char const * >(strings.data), strings.size)) != header.toc_hash) {
+		throw std::runtime_error("Bundle '" + filename + "' has a damaged table of contents.");
+	}
+
+	reader.view< unsigned char >("pad0"); //(just zeros)
+
+	ChunkView< unsigned char > contents = reader.view< unsigned char >("dat0");
+	if (size_t(contents.data - file->data) % BundleAlignment != 0) {
+		throw std::runtime_error("Bundle '" + filename + "' has misaligned contents.");
+	}
+
+	slices.reserve(entries.size);
+	for (auto const &entry : entries) {
+		if (entry.name_begin > entry.name_end || entry.name_end > strings.size) {
+			throw std::runtime_error("Invalid name in bundle '" + filename + "'.");
+		}
+		if (entry.offset > contents.size || contents.size - entry.offset < entry.size || entry.offset % BundleAlignment != 0) {
+			throw std::runtime_error("Invalid offset or size in bundle '" + filename + "'.");
+		}
+		Slice slice;
+		slice.name = std::string(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+		slice.data = contents.begin() + entry.offset;
+		slice.size = size_t(entry.size);
+		slice.hash = entry.hash;
+		auto ret = slices.insert(std::make_pair(slice.name, slice));
+		if (!ret.second) {
+			throw std::runtime_error("File with duplicate name '" + slice.name + "' in bundle '" + filename + "'.");
+		}
+	}
+}
+
+Bundle::~Bundle() {
+	//(out of line, where MappedFile is a complete type)
+}
+
+Bundle::Slice const &Bundle::get(std::string const &name) const {
+	auto f = slices.find(name);
+	if (f == slices.end()) {
+		throw std::runtime_error("File '" + name + "' not found in bundle '" + filename + "'.");
+	}
+	return f->second;
+}
+
+void Bundle::verify() const {
+	for (auto const &name_slice : slices) {
+		Slice const &slice = name_slice.second;
+		if (bundle_hash(slice.data, slice.size) != slice.hash) {
+			throw std::runtime_error("File '" + slice.name + "' in bundle '" + filename + "' doesn't match its hash.");
+		}
+	}
+}
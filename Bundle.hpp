@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <istream>
+#include <streambuf>
+#include <cstdint>
+#include <cstddef>
+
+struct MappedFile;
+
+/*
+ * A Bundle is many asset files packed into one (by the pack-bundle tool), so the game can map all of
+ * its assets with a single open and mmap, then hand loaders slices of the mapped file without copying.
+ *
+ * Bundles are chunks in the read_write_chunk.hpp format:
+ *  "bdl0" -- one BundleHeader
+ *  "str0" -- names of the packed files (not zero-terminated; see BundleEntry)
+ *  "toc0" -- one BundleEntry per packed file (the table of contents)
+ *  "pad0" -- zeros, so that "dat0"'s contents start at a multiple of BundleAlignment into the file
+ *  "dat0" -- the packed files, each starting at a multiple of BundleAlignment into the chunk's contents
+ * so every packed file starts BundleAlignment-aligned in memory (mapped files are page-aligned),
+ * which is plenty for SIMD loads and keeps small files from straddling cache lines.
+ */
+
+constexpr uint32_t const BundleAlignment = 64;
+
+struct BundleHeader {
+	uint32_t version = 1;
+	uint32_t count = 0; //number of packed files
+	uint64_t toc_hash = 0; //bundle_hash of the "str0" then "toc0" contents (which include every file's hash)
+};
+static_assert(sizeof(BundleHeader) == 16, "BundleHeader is packed");
+
+struct BundleEntry {
+	uint32_t name_begin = 0, name_end = 0; //name is str0[name_begin, name_end)
+	uint64_t offset = 0; //from the start of "dat0"'s contents
+	uint64_t size = 0;
+	uint64_t hash = 0; //bundle_hash of the file's contents
+};
+static_assert(sizeof(BundleEntry) == 32, "BundleEntry is packed");
+
+//64-bit FNV-1a hash; fast, and plenty to catch a stale or damaged bundle (this isn't for security):
+// (pass the result back in as 'hash' to continue hashing more data)
+uint64_t bundle_hash(unsigned char const *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL);
+
+struct Bundle {
+	//map a bundle and read its table of contents; throws on error:
+	Bundle(std::string const &filename);
+	~Bundle();
+	Bundle(Bundle const &) = delete;
+	Bundle &operator=(Bundle const &) = delete;
+
+	//a packed file -- points straight into the mapping, so it lives as long as the Bundle does:
+	struct Slice {
+		std::string name;
+		unsigned char const *data = nullptr;
+		size_t size = 0;
+		uint64_t hash = 0;
+	};
+
+	//look up a packed file by name; throws if it isn't in the bundle:
+	Slice const &get(std::string const &name) const;
+	bool has(std::string const &name) const { return slices.count(name) != 0; }
+
+	//re-hash every packed file and compare against the table of contents; throws on mismatch:
+	// (this reads the whole bundle, so the game doesn't do it; pack-bundle does, after writing one)
+	void verify() const;
+
+	std::string filename; //for error messages
+	std::unique_ptr< MappedFile > file;
+	std::unordered_map< std::string, Slice > slices;
+};
+
+//Read a slice as a std::istream, without copying it (for loaders that take streams):
+struct SliceBuffer : std::streambuf {
+	SliceBuffer(Bundle::Slice const &slice) {
+		char *begin = const_cast< char * >(reinterpret_cast< char const * >(slice.data)); //(only ever read)
+		setg(begin, begin, begin + slice.size);
+	}
+};
+struct SliceStream : private SliceBuffer, public std::istream {
+	SliceStream(Bundle::Slice const &slice) : SliceBuffer(slice), std::istream(static_cast< SliceBuffer * >(this)) { }
+};
@@ -3,7 +3,7 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
-Load< ColorTextureProgram > color_texture_program(LoadTagEarly);
+Load< ColorTextureProgram > color_texture_program(LoadTagDefault, new_T< ColorTextureProgram >, LoadOnMainThread, "color_texture_program");
 
 ColorTextureProgram::ColorTextureProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
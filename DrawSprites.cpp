@@ -14,7 +14,8 @@
 
 #include <algorithm>
 
-//All DrawSprites instances share a vertex array object and vertex buffer, initialized at load time:
+//All DrawSprites instances share a vertex array object and vertex buffer, initialized at load time
+// (once color_texture_program, whose attribute locations they use, has loaded):
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
@@ -78,7 +79,7 @@ Load< void > setup_buffers(LoadTagDefault, [](){
 	}
 
 	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
-});
+}, LoadOnMainThread, "DrawSprites setup_buffers", { &color_texture_program });
 
 
 DrawSprites::DrawSprites(
@@ -156,8 +157,8 @@ DrawSprites::DrawSprites(
 void DrawSprites::draw(Sprite const &sprite, glm::vec2 const &center, float scale, glm::u8vec4 const &tint) {
 	glm::vec2 min = center + scale * (sprite.min_px - sprite.anchor_px);
 	glm::vec2 max = center + scale * (sprite.max_px - sprite.anchor_px);
-	glm::vec2 min_tc = sprite.min_px / glm::vec2(atlas.tex_size);
-	glm::vec2 max_tc = sprite.max_px / glm::vec2(atlas.tex_size);
+	glm::vec2 const &min_tc = sprite.min_tc;
+	glm::vec2 const &max_tc = sprite.max_tc;
 
 	if (mode == AlignPixelPerfect) {
 		//nudge min/max so that pixels line up just ~just so~
@@ -2,62 +2,116 @@
 #include "Sprite.hpp"
 #include "DrawSprites.hpp"
 #include "Load.hpp"
-#include "data_path.hpp"
 #include "gl_errors.hpp"
 #include "MenuMode.hpp"
 #include "Sound.hpp"
+#include "Bundle.hpp"
+#include "game_assets.hpp"
 
 //for glm::value_ptr() :
 #include <glm/gtc/type_ptr.hpp>
 
 #include <random>
+#include <algorithm>
 
+//background music stays compressed in memory and is decoded when needed (see Sound::Sample::Cached);
+// the next environment's track is prefetched when the warning plays, two seconds before the switch.
+//Only the first environment's track is needed right away; the others aren't played until ten seconds
+// in, so they are loaded lazily (see LoadTagLazy), in the background, once the game has started.
+//(it plays on the music bus, so environment effects can treat it differently from the flaps)
 Load< Sound::Sample > music_air(LoadTagDefault, []() -> Sound::Sample * {
-	return new Sound::Sample(data_path("advertising.opus"));
-});
-Load< Sound::Sample > music_mud(LoadTagDefault, []() -> Sound::Sample * {
-	return new Sound::Sample(data_path("whistle.opus"));
-});
-Load< Sound::Sample > music_water(LoadTagDefault, []() -> Sound::Sample * {
-	return new Sound::Sample(data_path("ins.opus"));
-});
-Load< Sound::Sample > music_ice(LoadTagDefault, []() -> Sound::Sample * {
-	return new Sound::Sample(data_path("ukulele.opus"));
-});
-
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "advertising.opus", Sound::Sample::Cached);
+	ret->bus = Sound::BusMusic;
+	return ret;
+}, LoadOnAnyThread, "music_air", { &game_assets });
+Load< Sound::Sample > music_mud(LoadTagLazy, []() -> Sound::Sample * {
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "whistle.opus", Sound::Sample::Cached);
+	ret->bus = Sound::BusMusic;
+	return ret;
+}, LoadOnAnyThread, "music_mud", { &game_assets });
+Load< Sound::Sample > music_water(LoadTagLazy, []() -> Sound::Sample * {
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "ins.opus", Sound::Sample::Cached);
+	ret->bus = Sound::BusMusic;
+	return ret;
+}, LoadOnAnyThread, "music_water", { &game_assets });
+Load< Sound::Sample > music_ice(LoadTagLazy, []() -> Sound::Sample * {
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "ukulele.opus", Sound::Sample::Cached);
+	ret->bus = Sound::BusMusic;
+	return ret;
+}, LoadOnAnyThread, "music_ice", { &game_assets });
+
+//the warning and death sounds duck the music while they play (see the sidechain set up in FlappyMode()):
 Load< Sound::Sample > music_warn(LoadTagDefault, []() -> Sound::Sample *{
-	return new Sound::Sample(data_path("warn.opus"));
-});
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "warn.opus", Sound::Sample::Cached);
+	ret->ducks = true;
+	return ret;
+}, LoadOnAnyThread, "music_warn", { &game_assets });
 
 Load< Sound::Sample > music_die(LoadTagDefault, []() -> Sound::Sample *{
-	return new Sound::Sample(data_path("death.opus"));
-});
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "death.opus", Sound::Sample::Cached);
+	ret->ducks = true;
+	return ret;
+}, LoadOnAnyThread, "music_die", { &game_assets });
 
+//movement sounds are phase-modulated sine waves (see Sound::Tone), generated by the mixer as they play:
 Load< Sound::Sample > music_up(LoadTagDefault, []() -> Sound::Sample *{
-	std::vector< float > data(size_t(48000 * 0.2f), 0.0f);
-	for (uint32_t i = 0; i < data.size(); ++i) {
-		float t = i / float(48000);
-		//phase-modulated sine wave (creates some metal-like sound):
-		data[i] = std::sin(3.1415926f * 2.0f * 220.0f * t + std::sin(3.1415926f * 2.0f * 200.0f * t));
-		//quadratic falloff:
-		data[i] *= 0.3f * std::pow(std::max(0.0f, (1.0f - t / 0.2f)), 2.0f);
-	}
-	return new Sound::Sample(data);
-});
+	Sound::Tone tone;
+	tone.carrier_hz = 220.0f;
+	tone.modulator_hz = 200.0f;
+	return new Sound::Sample(tone);
+}, LoadOnAnyThread, "music_up");
 
 Load< Sound::Sample > music_down(LoadTagDefault, []() -> Sound::Sample *{
-	std::vector< float > data(size_t(48000 * 0.2f), 0.0f);
-	for (uint32_t i = 0; i < data.size(); ++i) {
-		float t = i / float(48000);
-		//phase-modulated sine wave (creates some metal-like sound):
-		data[i] = std::sin(-3.1415926f * 2.0f * 220.0f * t + std::sin(3.1415926f * 2.0f * 200.0f * t));
-		//quadratic falloff:
-		data[i] *= 0.3f * std::pow(std::max(0.0f, (1.0f - t / 0.2f)), 2.0f);
+	Sound::Tone tone;
+	tone.carrier_hz = -220.0f;
+	tone.modulator_hz = 200.0f;
+	return new Sound::Sample(tone);
+}, LoadOnAnyThread, "music_down");
+
+//background music for each environment:
+static Sound::Sample const &environ_music(int environ) {
+	if (environ == 3) return *music_air;
+	else if (environ == 0) return *music_mud;
+	else if (environ == 1) return *music_ice;
+	else return *music_water;
+}
+
+//flaps sound lower in heavy environments and higher in light ones (the mixer resamples as they play):
+static float environ_pitch(int environ) {
+	if (environ == 3) return 1.25f; //air
+	else if (environ == 0) return 0.75f; //mud
+	else if (environ == 1) return 1.1f; //ice
+	else return 0.9f; //water
+}
+
+//water muffles everything; ice gives the flaps an echo:
+static void set_environ_effects(int environ) {
+	Sound::Effect muffle, echo;
+	if (environ == 2) {
+		muffle.type = Sound::Effect::LowPass;
+		muffle.cutoff_hz = 600.0f;
+	} else if (environ == 1) {
+		echo.type = Sound::Effect::Reverb;
+		echo.room_size = 0.8f;
+		echo.wet = 0.4f;
 	}
-	return new Sound::Sample(data);
-});
+	Sound::set_bus_effect(Sound::BusMusic, 0, muffle);
+	Sound::set_bus_effect(Sound::BusSFX, 0, muffle);
+	Sound::set_bus_effect(Sound::BusSFX, 1, echo);
+}
 
 FlappyMode::FlappyMode() {
+	//(flap sounds are mixed in small blocks -- see Sound::init in main.cpp)
+
+	//first environment's music and the warning are needed right away:
+	Sound::prefetch(*music_air);
+	Sound::prefetch(*music_warn);
+	//...and the rest of the music can load while the first environment plays:
+	music_mud.prefetch();
+	music_ice.prefetch();
+	music_water.prefetch();
+	set_environ_effects(environ);
+	Sound::set_sidechain(Sound::BusMusic, Sound::Sidechain());
 
 	//set up bars and bars_radius
 	bars.clear();
@@ -152,6 +206,8 @@ FlappyMode::FlappyMode() {
 }
 
 FlappyMode::~FlappyMode() {
+	set_environ_effects(3); //(air has no effects)
+	Sound::clear_sidechain(Sound::BusMusic);
 
 	//----- free OpenGL resources -----
 	glDeleteBuffers(1, &vertex_buffer);
@@ -168,10 +224,10 @@ bool FlappyMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 
 	if (evt.button.button == SDL_BUTTON_LEFT) {
 		bird_velocity = glm::vec2(bird_velocity.x,bird_velocity.y+0.5);
-		Sound::play(*music_up);
+		Sound::play(*music_up, 1.0f, 0.0f, 0, environ_pitch(environ));
 	}else if 	(evt.button.button == SDL_BUTTON_RIGHT) {
 		bird_velocity = glm::vec2(bird_velocity.x,bird_velocity.y-0.5);
-		Sound::play(*music_down);
+		Sound::play(*music_down, 1.0f, 0.0f, 0, environ_pitch(environ));
 	}
 	return false;
 }
@@ -181,29 +237,43 @@ void FlappyMode::update(float elapsed) {
 	static std::mt19937 mt; //mersenne twister pseudo-random number generator
 	//----- flappy enrionment update
 	if (!bgm) {
-		bgm = Sound::play(*music_air, 1.0f);
+		//(scheduled a little ahead, so the start -- and every switch after it -- lands on an exact frame)
+		environ_clock = Sound::mix_clock() + 48000 / 10;
+		bgm = Sound::loop_at(*music_air, environ_clock, 1.0f);
+	}
+	//environments follow the music, so while the mixer is running, environ_time is read off its clock
+	// (main.cpp clamps 'elapsed' on slow frames, so adding that up would fall further behind each time);
+	// without audio, the mixer's clock doesn't move, and 'elapsed' is all there is:
+	uint64_t now = Sound::mix_clock();
+	if (now != last_mix_clock) {
+		environ_time = float(int64_t(now - environ_clock)) / 48000.0f;
+		last_mix_clock = now;
+	} else {
+		environ_time+=elapsed;
 	}
-	environ_time+=elapsed;
-	if(environ_time>10){
+	float switch_time = float(switch_clock - environ_clock) / 48000.0f;
+	if(music_switch_scheduled && environ_time>=switch_time){
 		environ=next_environ;
+		set_environ_effects(environ);
 		next_environ=-1;
-		environ_time=0;
-		bgm->stop(0);
-		if(environ==3){
-			bgm = Sound::play(*music_air, 1.0f);		
-		}else if (environ==0){
-			bgm = Sound::play(*music_mud, 1.0f);		
-		}else if (environ==1){
-			bgm = Sound::play(*music_ice, 1.0f);		
-		}else{
-			bgm = Sound::play(*music_water, 1.0f);					
-		}
+		environ_time-=switch_time;
+		environ_clock=switch_clock;
+		music_switch_scheduled=false;
+		//(the music switched over at switch_clock, by the crossfade scheduled below)
 
 		left_score+=1;
 	}
-	if(environ_time<10 && environ_time>8 && next_environ==-1){
+	if(environ_time>8 && next_environ==-1){ //(no upper limit: a long hitch can skip right past ten seconds of music)
 		next_environ=int((mt() / float(mt.max())) * 3.99f);
 		Sound::play(*music_warn, 1.0f);
+		Sound::prefetch(environ_music(next_environ));
+	}
+	if(environ_time>9.5 && next_environ!=-1 && !music_switch_scheduled){
+		//switch music exactly ten seconds of audio after the last switch -- unless that has already been
+		// mixed (e.g., after a long hitch), in which case switch as soon as an exact frame can be scheduled:
+		switch_clock = std::max(environ_clock + 10 * 48000, Sound::mix_clock() + 48000 / 10);
+		bgm = Sound::crossfade(bgm, environ_music(next_environ), switch_clock, 0.1f, 1.0f, true);
+		music_switch_scheduled=true;
 	}
 
 	//----- bird update -----
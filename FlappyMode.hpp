@@ -35,6 +35,10 @@ struct FlappyMode : Mode {
 	float last_change_time=0;
 	float environ_time=0;
 	int next_environ=-1;
+	uint64_t environ_clock=0; //Sound::mix_clock() frame the current environment's music started at
+	bool music_switch_scheduled=false; //crossfade to next_environ's music has been scheduled...
+	uint64_t switch_clock=0; //...for this Sound::mix_clock() frame (the visuals switch along with it)
+	uint64_t last_mix_clock=0; //Sound::mix_clock() at the last update (to tell if the mixer is running)
 	uint32_t left_score = 0;
 	std::deque< glm::vec2 > bars;
 	std::deque< glm::vec2 > bars_radius;
@@ -69,5 +73,5 @@ struct FlappyMode : Mode {
 	glm::mat3x2 clip_to_court = glm::mat3x2(1.0f);
 	// computed in draw() as the inverse of OBJECT_TO_CLIP
 	// (stored here so that the mouse handling code can use it to position the paddle)
-	std::shared_ptr< Sound::PlayingSample > bgm;
+	Sound::PlayingSample bgm;
 };
@@ -1,20 +1,97 @@
 #include "Load.hpp"
 
-#include <array>
 #include <list>
+#include <vector>
+#include <map>
+#include <deque>
 #include <cassert>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <algorithm>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct LoadFunction {
+		std::function< void() > fn;
+		LoadTag tag = LoadTagDefault;
+		LoadThread thread = LoadOnMainThread;
+		std::string name;
+		LoadBase const *owner = nullptr;
+		LoadAfter after;
+		enum State {
+			NotLoaded,
+			Loading, //(only used for lazy loads; startup loads go straight to Loaded when the graph finishes)
+			Loaded,
+		} state = NotLoaded; //guarded by lazy_mutex once call_load_functions has finished
+	};
+
+	std::list< LoadFunction > &get_load_functions() {
+		static std::list< LoadFunction > load_functions;
+		return load_functions;
+	}
+
+	//lazy loading:
+	std::mutex lazy_mutex;
+	std::condition_variable lazy_finished; //signalled whenever a lazy load stops Loading
+	bool startup_finished = false; //set once call_load_functions is done (guarded by lazy_mutex)
+
+	//background thread for prefetch_load:
+	struct Prefetcher {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque< LoadBase const * > queue;
+		bool quit = false;
+
+		Prefetcher() {
+			thread = std::thread([this](){
+				std::unique_lock< std::mutex > lock(mutex);
+				while (true) {
+					while (!quit && queue.empty()) wake.wait(lock);
+					if (quit) break;
+					LoadBase const *owner = queue.front();
+					queue.pop_front();
+					lock.unlock();
+					try {
+						load_now(owner);
+					} catch (std::exception &e) {
+						std::cerr << "Prefetching failed (will try again on first use): " << e.what() << std::endl;
+					}
+					lock.lock();
+				}
+			});
+		}
+		~Prefetcher() {
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				quit = true;
+			}
+			wake.notify_one();
+			thread.join();
+		}
+	};
+	//(created on first use, so that -- being destroyed in reverse order -- it stops before the load function list goes away)
+	Prefetcher &get_prefetcher() {
+		static Prefetcher prefetcher;
+		return prefetcher;
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread, std::string const &name, LoadBase const *owner, LoadAfter const &after) {
+	assert(tag < MaxLoadTag);
+	LoadFunction load_function;
+	load_function.fn = fn;
+	load_function.tag = tag;
+	load_function.thread = thread;
+	load_function.name = name;
+	load_function.owner = owner;
+	load_function.after = after;
+	get_load_functions().emplace_back(load_function);
 }
 
 void call_load_functions() {
@@ -22,11 +99,303 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto load_start = Clock::now();
+
+	//---- build the graph ----
+	//functions, in tag order (and, within a tag, the order they were added):
+	// (lazy functions are included so that their dependencies get checked, but are only run if something else needs them)
+	std::vector< LoadFunction * > fns;
+	for (uint32_t tag = 0; tag < MaxLoadTag; ++tag) {
+		for (auto &lf : get_load_functions()) {
+			if (lf.tag != tag) continue;
+			if (lf.name.empty()) lf.name = "(tag " + std::to_string(tag) + " #" + std::to_string(fns.size()) + ")";
+			fns.emplace_back(&lf);
+		}
+	}
+
+	struct Node {
+		std::vector< uint32_t > needs; //functions that must finish before this one starts
+		std::vector< uint32_t > needed_by; //...and the reverse
+		uint32_t waiting_on = 0; //needs not yet finished (while running)
+		bool run = false; //run at startup? (everything but lazy functions that nothing else needs)
+		double start_ms = 0.0, end_ms = 0.0; //relative to load_start
+		bool on_worker = false;
+	};
+	std::vector< Node > nodes(fns.size());
+
+	std::map< LoadBase const *, uint32_t > owned_by;
+	for (uint32_t i = 0; i < fns.size(); ++i) {
+		if (fns[i]->owner) owned_by[fns[i]->owner] = i;
+	}
+
+	for (uint32_t i = 0; i < fns.size(); ++i) {
+		auto &needs = nodes[i].needs;
+		for (LoadBase const *after : fns[i]->after) {
+			auto f = owned_by.find(after);
+			if (f == owned_by.end()) {
+				throw std::runtime_error("Loading '" + fns[i]->name + "' needs something that was never added as a load function.");
+			}
+			needs.emplace_back(f->second);
+		}
+		//tags: wait for everything with the last earlier tag (which, in turn, waited for everything before it):
+		// (lazy functions only wait for what they list -- they're loaded whenever something needs them)
+		uint32_t prev_tag_end = i;
+		while (prev_tag_end > 0 && fns[prev_tag_end-1]->tag == fns[i]->tag) --prev_tag_end;
+		for (uint32_t j = prev_tag_end; fns[i]->tag != LoadTagLazy && j > 0 && fns[j-1]->tag == fns[prev_tag_end-1]->tag; --j) {
+			needs.emplace_back(j-1);
+		}
+		std::sort(needs.begin(), needs.end());
+		needs.erase(std::unique(needs.begin(), needs.end()), needs.end());
+		for (uint32_t n : needs) nodes[n].needed_by.emplace_back(i);
+		nodes[i].waiting_on = uint32_t(needs.size());
+	}
+
+	{ //check for cycles by peeling off functions that have nothing left to wait for:
+		std::vector< uint32_t > waiting(fns.size());
+		std::vector< uint32_t > ready;
+		for (uint32_t i = 0; i < fns.size(); ++i) {
+			waiting[i] = nodes[i].waiting_on;
+			if (waiting[i] == 0) ready.emplace_back(i);
+		}
+		uint32_t peeled = 0;
+		while (!ready.empty()) {
+			uint32_t i = ready.back();
+			ready.pop_back();
+			++peeled;
+			for (uint32_t n : nodes[i].needed_by) {
+				if (--waiting[n] == 0) ready.emplace_back(n);
+			}
+		}
+		if (peeled != fns.size()) {
+			//whatever is left is (or waits on) a cycle; follow unfinished needs until one repeats:
+			uint32_t at = 0;
+			while (waiting[at] == 0) ++at;
+			std::vector< uint32_t > path;
+			std::vector< bool > on_path(fns.size(), false);
+			while (!on_path[at]) {
+				on_path[at] = true;
+				path.emplace_back(at);
+				for (uint32_t n : nodes[at].needs) {
+					if (waiting[n] != 0) {
+						at = n;
+						break;
+					}
+				}
+			}
+			std::string cycle = fns[at]->name;
+			for (auto p = std::find(path.begin(), path.end(), at) + 1; p != path.end(); ++p) {
+				cycle += " needs " + fns[*p]->name;
+			}
+			cycle += " needs " + fns[at]->name;
+			throw std::runtime_error("Loading functions depend on each other in a cycle: " + cycle + ".");
+		}
+	}
+
+	//---- run the graph ----
+	//run everything except lazy functions, plus any lazy functions those need:
+	uint32_t to_run = 0;
+	{
+		std::vector< uint32_t > todo;
+		for (uint32_t i = 0; i < fns.size(); ++i) {
+			if (fns[i]->tag != LoadTagLazy) todo.emplace_back(i);
+		}
+		while (!todo.empty()) {
+			uint32_t i = todo.back();
+			todo.pop_back();
+			if (nodes[i].run) continue;
+			nodes[i].run = true;
+			++to_run;
+			todo.insert(todo.end(), nodes[i].needs.begin(), nodes[i].needs.end());
+		}
+	}
+
+	//functions whose needs have all finished wait here for a thread:
+	std::deque< uint32_t > ready_main, ready_any;
+	for (uint32_t i = 0; i < fns.size(); ++i) {
+		if (nodes[i].run && nodes[i].waiting_on == 0) (fns[i]->thread == LoadOnAnyThread ? ready_any : ready_main).emplace_back(i);
+	}
+	uint32_t finished = 0;
+	uint32_t running = 0;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	//take a ready function (if there is one and nothing has failed), run it, and release whatever it was holding up;
+	// returns false if there is nothing left for this thread to do:
+	auto run_one = [&](bool on_worker, std::unique_lock< std::mutex > &lock) -> bool {
+		while (true) {
+			bool done = (error ? running == 0 : finished == to_run);
+			if (done) return false;
+			if (!error) {
+				std::deque< uint32_t > *queue = nullptr;
+				if (!on_worker && !ready_main.empty()) queue = &ready_main;
+				else if (!ready_any.empty()) queue = &ready_any;
+				if (queue) {
+					uint32_t i = queue->front();
+					queue->pop_front();
+					++running;
+					lock.unlock();
+
+					nodes[i].start_ms = std::chrono::duration< double, std::milli >(Clock::now() - load_start).count();
+					std::exception_ptr fn_error;
+					try {
+						fns[i]->fn();
+					} catch (...) {
+						fn_error = std::current_exception();
+					}
+					nodes[i].end_ms = std::chrono::duration< double, std::milli >(Clock::now() - load_start).count();
+					nodes[i].on_worker = on_worker;
+
+					lock.lock();
+					--running;
+					++finished;
+					if (fn_error && !error) error = fn_error;
+					for (uint32_t n : nodes[i].needed_by) {
+						if (--nodes[n].waiting_on == 0 && nodes[n].run) (fns[n]->thread == LoadOnAnyThread ? ready_any : ready_main).emplace_back(n);
+					}
+					wake.notify_all();
+					return true;
+				}
+			}
+			wake.wait(lock);
+		}
+	};
+
+	uint32_t any_count = 0;
+	for (uint32_t i = 0; i < fns.size(); ++i) any_count += (nodes[i].run && fns[i]->thread == LoadOnAnyThread);
+	uint32_t worker_count = std::min< uint32_t >(any_count, std::max(1U, std::thread::hardware_concurrency()) );
+	std::vector< std::thread > workers;
+	workers.reserve(worker_count);
+	for (uint32_t w = 0; w < worker_count; ++w) {
+		workers.emplace_back([&](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (run_one(true, lock)) { }
+		});
+	}
+	{ //the main thread runs main-thread functions, and helps with the rest while it waits:
+		std::unique_lock< std::mutex > lock(mutex);
+		while (run_one(false, lock)) { }
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	if (error) std::rethrow_exception(error);
+
+	//---- report ----
+	double total_ms = std::chrono::duration< double, std::milli >(Clock::now() - load_start).count();
+	double serial_ms = 0.0;
+	for (auto const &node : nodes) serial_ms += node.end_ms - node.start_ms;
+
+	//slowest first:
+	std::vector< uint32_t > order;
+	for (uint32_t i = 0; i < fns.size(); ++i) {
+		if (nodes[i].run) order.emplace_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+		return nodes[a].end_ms - nodes[a].start_ms > nodes[b].end_ms - nodes[b].start_ms;
+	});
+	std::cout << "Loaded " << to_run << " items in " << total_ms << " ms (" << serial_ms << " ms if run one at a time; " << (fns.size() - to_run) << " more left to load on first use):\n";
+	for (uint32_t i : order) {
+		std::cout << "  " << (nodes[i].end_ms - nodes[i].start_ms) << " ms  " << fns[i]->name << (nodes[i].on_worker ? "" : " [main thread]") << "\n";
+	}
+
+	//critical path: starting from whatever finished last, walk back through whichever need finished last
+	// (the one it was actually waiting for); anywhere a function started well after that need finished,
+	// it was waiting for a thread, not a dependency:
+	if (!order.empty()) {
+		uint32_t at = order[0];
+		for (uint32_t i : order) {
+			if (nodes[i].end_ms > nodes[at].end_ms) at = i;
+		}
+		std::vector< uint32_t > path;
+		while (true) {
+			path.emplace_back(at);
+			if (nodes[at].needs.empty()) break;
+			uint32_t last = nodes[at].needs[0];
+			for (uint32_t n : nodes[at].needs) {
+				if (nodes[n].end_ms > nodes[last].end_ms) last = n;
+			}
+			at = last;
+		}
+		std::reverse(path.begin(), path.end());
+		std::cout << "Critical path (" << nodes[path.back()].end_ms << " ms):\n";
+		for (uint32_t i : path) {
+			std::cout << "  " << nodes[i].start_ms << " - " << nodes[i].end_ms << " ms  " << fns[i]->name << "\n";
+		}
+	}
+	std::cout.flush();
+
+	//lazy functions stay around (with everything else, so they can check their 'after' was loaded):
+	std::lock_guard< std::mutex > lock(lazy_mutex);
+	for (uint32_t i = 0; i < fns.size(); ++i) {
+		if (nodes[i].run) {
+			fns[i]->state = LoadFunction::Loaded;
+			fns[i]->fn = nullptr; //(done with it; let go of anything it captured)
 		}
 	}
+	startup_finished = true;
+}
+
+void load_now(LoadBase const *owner) {
+	LoadFunction *lf = nullptr;
+	{
+		std::unique_lock< std::mutex > lock(lazy_mutex);
+		if (!startup_finished) {
+			throw std::runtime_error("A lazy Load<> was used before call_load_functions() finished (if a loading function needs it, list it in 'after').");
+		}
+		for (auto &f : get_load_functions()) {
+			if (f.owner == owner) {
+				lf = &f;
+				break;
+			}
+		}
+		if (!lf) {
+			throw std::runtime_error("load_now() was asked to load something that was never added as a load function.");
+		}
+		while (lf->state == LoadFunction::Loading) lazy_finished.wait(lock);
+		if (lf->state == LoadFunction::Loaded) return;
+		lf->state = LoadFunction::Loading;
+	}
+
+	auto before = Clock::now();
+	try {
+		//(call_load_functions already checked these can't lead back here)
+		for (LoadBase const *after : lf->after) {
+			load_now(after);
+		}
+		lf->fn();
+	} catch (...) {
+		{
+			std::lock_guard< std::mutex > lock(lazy_mutex);
+			lf->state = LoadFunction::NotLoaded;
+		}
+		lazy_finished.notify_all();
+		throw;
+	}
+	double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+	{
+		std::lock_guard< std::mutex > lock(lazy_mutex);
+		lf->state = LoadFunction::Loaded;
+		lf->fn = nullptr;
+	}
+	lazy_finished.notify_all();
+
+	std::cout << "Loaded " << lf->name << " on first use in " << ms << " ms." << std::endl;
+}
+
+void prefetch_load(LoadBase const *owner) {
+	{ //main-thread functions can't be run in the background, so they will just have to wait for first use:
+		std::lock_guard< std::mutex > lock(lazy_mutex);
+		for (auto const &f : get_load_functions()) {
+			if (f.owner == owner && f.thread == LoadOnMainThread) return;
+		}
+	}
+	Prefetcher &prefetcher = get_prefetcher();
+	{
+		std::lock_guard< std::mutex > lock(prefetcher.mutex);
+		prefetcher.queue.emplace_back(owner);
+	}
+	prefetcher.wake.notify_one();
 }
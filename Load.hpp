@@ -15,66 +15,140 @@
  *     glBindVertexArray(main_mesh->vao);
  * }
  *
- * Load<> is built on the add_load_function() call that adds a function to one of several lists of functions that are called after the OpenGL canvas is initialized.
+ * Load<> is built on the add_load_function() call that adds a function to a graph of functions that are called after the OpenGL canvas is initialized.
  *
- * These functions are grouped by 'tags', which allow some sequencing of calls.
+ * A Load<> can list other Load<>s it needs, and won't be called until they have finished:
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Load< void > setup_buffers(LoadTagDefault, [](){
+ *     glVertexAttribPointer(color_texture_program->Position_vec4, ...);
+ * }, LoadOnMainThread, "setup_buffers", { &color_texture_program });
+ *
+ * Functions are also grouped by 'tags': every function with one tag waits for all functions with earlier tags.
+ * (this is a much coarser ordering -- listing dependencies lets more functions run at once.)
+ *
+ * Functions marked LoadOnAnyThread (CPU-only work like decoding or synthesizing audio)
+ * are run in parallel on a pool of worker threads as soon as what they need is loaded, while the rest run on the main thread:
+ *
+ * Load< Sound::Sample > music(LoadTagDefault, []() -> Sound::Sample const * {
+ *     return new Sound::Sample(data_path("music.opus"));
+ * }, LoadOnAnyThread, "music");
+ *
+ * The (optional) name is used in error messages and when reporting how long each loading function took
+ * (and which chain of dependencies took longest -- i.e., what is holding up startup).
+ *
+ * Functions tagged LoadTagLazy aren't called at startup (unless some other function lists them in 'after');
+ * instead, the Load<> is loaded the first time it is used, on whatever thread uses it.
+ * To keep that first use from stalling, prefetch() can start loading it on a background thread ahead of time:
+ *
+ * Load< Sound::Sample > boss_music(LoadTagLazy, []() -> Sound::Sample const * {
+ *     return new Sound::Sample(data_path("boss.opus"));
+ * }, LoadOnAnyThread, "boss_music");
+ *
+ * //when the boss fight is getting close:
+ * boss_music.prefetch();
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <atomic>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
+	LoadTagLazy, //loaded on first use (see above)
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
-//Add a function to an internal list of loading functions:
+enum LoadThread : uint32_t {
+	LoadOnMainThread, //must run on the main thread (e.g., anything that uses OpenGL)
+	LoadOnAnyThread, //may run on a worker thread (must not touch OpenGL or other loaders' results)
+};
+
+//Every Load<> is a LoadBase, so Load<>s of any type can be named as dependencies:
+struct LoadBase {
+};
+//(dependencies are given by address, which is fine even if the other Load<> hasn't been constructed yet)
+typedef std::vector< LoadBase const * > LoadAfter;
+
+//Add a function to an internal graph of loading functions:
+// 'owner' is the Load<> it fills in (or nullptr), which other functions may list in their 'after'.
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread = LoadOnMainThread, std::string const &name = "", LoadBase const *owner = nullptr, LoadAfter const &after = LoadAfter());
 
 //Call all loading functions:
+// (a function starts once all functions with earlier tags and all of its 'after' have finished.)
+// (throws if some function's 'after' names something that isn't loaded, or if dependencies form a cycle.)
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
 void call_load_functions();
 
+//Call a LoadTagLazy function (after whatever it lists in 'after') now, if it hasn't been called already:
+// (thread-safe; if another thread is already calling it, waits for that thread to finish)
+// (throws if the function fails -- a later call will try again)
+// (only call *after* "call_load_functions()")
+void load_now(LoadBase const *owner);
+
+//Queue a LoadTagLazy function to be called by load_now on a background thread:
+// (failures are reported but not thrown; first use will try again, and throw)
+// (LoadOnMainThread functions are skipped -- they are left for first use, which must then be on the main thread)
+void prefetch_load(LoadBase const *owner);
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
 T const *new_T() { return new T; }
 
 template< typename T >
-struct Load {
-	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+struct Load : LoadBase {
+	//Constructing a Load< T > adds the passed function to the graph of functions to call:
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, LoadThread thread = LoadOnMainThread, std::string const &name = "", LoadAfter const &after = LoadAfter()) : lazy(tag == LoadTagLazy), value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
-			this->value = load_fn();
-			if (!(this->value)) {
+			T const *loaded = load_fn();
+			if (!loaded) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+			this->value.store(loaded, std::memory_order_release);
+		}, thread, name, this, after);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	// (for LoadTagLazy, any of these loads the value if it hasn't been loaded yet)
+	explicit operator bool() { return get() != nullptr; }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	T const *get() {
+		T const *ret = value.load(std::memory_order_acquire);
+		if (!ret && lazy) {
+			load_now(this);
+			ret = value.load(std::memory_order_acquire);
+		}
+		return ret;
+	}
+
+	//Start loading a LoadTagLazy value in the background (does nothing for other tags):
+	void prefetch() {
+		if (lazy && !value.load(std::memory_order_acquire)) prefetch_load(this);
+	}
 
-	T const *value;
+	bool const lazy;
+	std::atomic< T const * > value;
 };
 
 
 //Specialization:
 //Load< void > just calls a function:
 template< >
-struct Load< void > {
-	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+struct Load< void > : LoadBase {
+	//Constructing a Load< T > adds the passed function to the graph of functions to call:
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadThread thread = LoadOnMainThread, std::string const &name = "", LoadAfter const &after = LoadAfter()) {
+		add_load_function(tag, load_fn, thread, name, this, after);
 	}
 };
 
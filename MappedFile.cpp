@@ -0,0 +1,68 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename_) : filename(filename_) {
+#ifdef _WIN32
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to get the size of '" + filename + "' (or it is empty).");
+	}
+	size = size_t(file_size.QuadPart);
+	void const *base = nullptr;
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle) base = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!base) {
+		if (mapping_handle) CloseHandle(mapping_handle);
+		CloseHandle(file_handle);
+		throw std::runtime_error("Failed to map '" + filename + "' into memory.");
+	}
+	data = reinterpret_cast< unsigned char const * >(base);
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get the size of '" + filename + "' (or it is empty).");
+	}
+	size = size_t(st.st_size);
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(the mapping keeps the file open)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map '" + filename + "' into memory.");
+	}
+	data = reinterpret_cast< unsigned char const * >(mapped);
+#endif
+}
+
+MappedFile::~MappedFile() {
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping_handle);
+	CloseHandle(file_handle);
+#else
+	munmap(const_cast< unsigned char * >(data), size);
+#endif
+	data = nullptr;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+//A whole file, memory-mapped read-only:
+// nothing is read or copied up front -- the OS pages the contents in as they are first touched,
+// and (since the pages are backed by the file) can drop them again under memory pressure.
+struct MappedFile {
+	//maps the file; throws on error (including if the file is empty):
+	MappedFile(std::string const &filename);
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	std::string filename; //for error messages
+	unsigned char const *data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#endif
+};
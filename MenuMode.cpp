@@ -14,29 +14,25 @@
 
 #include <random>
 
+//menu sounds are phase-modulated sine waves (see Sound::Tone), generated by the mixer as they play
+// (on the UI bus, so the game's effects leave them alone):
 Load< Sound::Sample > sound_click(LoadTagDefault, []() -> Sound::Sample *{
-	std::vector< float > data(size_t(48000 * 0.2f), 0.0f);
-	for (uint32_t i = 0; i < data.size(); ++i) {
-		float t = i / float(48000);
-		//phase-modulated sine wave (creates some metal-like sound):
-		data[i] = std::sin(3.1415926f * 2.0f * 440.0f * t + std::sin(3.1415926f * 2.0f * 450.0f * t));
-		//quadratic falloff:
-		data[i] *= 0.3f * std::pow(std::max(0.0f, (1.0f - t / 0.2f)), 2.0f);
-	}
-	return new Sound::Sample(data);
-});
+	Sound::Tone tone;
+	tone.carrier_hz = 440.0f;
+	tone.modulator_hz = 450.0f;
+	Sound::Sample *ret = new Sound::Sample(tone);
+	ret->bus = Sound::BusUI;
+	return ret;
+}, LoadOnAnyThread, "sound_click");
 
 Load< Sound::Sample > sound_clonk(LoadTagDefault, []() -> Sound::Sample *{
-	std::vector< float > data(size_t(48000 * 0.2f), 0.0f);
-	for (uint32_t i = 0; i < data.size(); ++i) {
-		float t = i / float(48000);
-		//phase-modulated sine wave (creates some metal-like sound):
-		data[i] = std::sin(3.1415926f * 2.0f * 220.0f * t + std::sin(3.1415926f * 2.0f * 200.0f * t));
-		//quadratic falloff:
-		data[i] *= 0.3f * std::pow(std::max(0.0f, (1.0f - t / 0.2f)), 2.0f);
-	}
-	return new Sound::Sample(data);
-});
+	Sound::Tone tone;
+	tone.carrier_hz = 220.0f;
+	tone.modulator_hz = 200.0f;
+	Sound::Sample *ret = new Sound::Sample(tone);
+	ret->bus = Sound::BusUI;
+	return ret;
+}, LoadOnAnyThread, "sound_clonk");
 
 
 MenuMode::MenuMode(std::vector< Item > const &items_) : items(items_) {
@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * SPSCRing< T > is a fixed-capacity, single-producer / single-consumer queue.
+ *
+ * Exactly one thread may call push() and exactly one (other) thread may call pop();
+ * neither call ever blocks or allocates, which makes it suitable for passing data
+ * into (or out of) the real-time audio callback.
+ *
+ * Storage is allocated once, in the constructor.
+ */
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+template< typename T >
+struct SPSCRing {
+	//capacity is rounded up to the next power of two:
+	explicit SPSCRing(uint32_t capacity_) {
+		uint32_t capacity = 1;
+		while (capacity < capacity_) capacity *= 2;
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	SPSCRing(SPSCRing const &) = delete;
+	SPSCRing &operator=(SPSCRing const &) = delete;
+
+	//(producer thread) add a value; returns false (and does nothing) if the ring is full:
+	bool push(T &&value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) return false;
+		slots[h & mask] = std::move(value);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	bool push(T const &value) {
+		T copy(value);
+		return push(std::move(copy));
+	}
+
+	//(consumer thread) remove the oldest value; returns false if the ring is empty:
+	bool pop(T *value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		*value = std::move(slots[t & mask]);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//zero-copy versions of push/pop, for when T is large:
+	//(producer thread) slot to fill in, or nullptr if the ring is full; call commit_write() once it is filled:
+	T *write_slot() {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) return nullptr;
+		return &slots[h & mask];
+	}
+	void commit_write() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	//(consumer thread) oldest value, or nullptr if the ring is empty; call commit_read() when done with it:
+	T *read_slot() {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return nullptr;
+		return &slots[t & mask];
+	}
+	void commit_read() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//(either thread) number of values in the ring; only a snapshot, since the other thread may be running:
+	uint32_t size() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+	uint32_t capacity() const { return mask + 1; }
+
+	//internals:
+	std::vector< T > slots;
+	uint32_t mask = 0;
+
+	//head and tail are kept on separate cache lines so producer and consumer don't fight over them:
+	// (padded apart rather than alignas(64), since over-aligned types can't be heap-allocated before C++17)
+	std::atomic< uint32_t > head{0}; //next slot to write (only modified by producer)
+	char head_padding[64 - sizeof(std::atomic< uint32_t >)];
+	std::atomic< uint32_t > tail{0}; //next slot to read (only modified by consumer)
+	char tail_padding[64 - sizeof(std::atomic< uint32_t >)];
+};
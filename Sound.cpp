@@ -1,30 +1,455 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "load_pcm.hpp"
+#include "Bundle.hpp"
+#include "SPSCRing.hpp"
+#include "mix_kernels.hpp"
+#include "bus_effects.hpp"
 
 #include <SDL.h>
 
-#include <list>
 #include <cassert>
 #include <exception>
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <limits>
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	//number of samples to mix per call of mix_audio callback is set by Sound::init / Sound::set_block_size:
+	// n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MIN_MIX_SAMPLES = 64;
+	constexpr uint32_t const MAX_MIX_SAMPLES = 4096;
+
+	//block size back-off (see Sound::update):
+	constexpr uint32_t const BACKOFF_MISSES = 3; //overruns within...
+	constexpr uint32_t const BACKOFF_WINDOW_MS = 5000; //...this long double the block size
+	constexpr uint32_t const RECOVER_MS = 30000; //time without overruns before halving it again
+
+	constexpr uint32_t const COMMAND_RING_SIZE = 4096; //commands that can be queued between two callbacks
+
+	constexpr uint64_t const NoTime = -1ULL; //"never", for scheduled starts and stops
+
+	//mixer sample clock (see Sound::mix_clock); only written by the mixer:
+	std::atomic< uint64_t > mix_clock_frames{0};
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
+	bool audio_initialized = false; //SDL audio subsystem is up (so the device can be reopened)
+	bool offline = false; //no device; audio is mixed by calls to Sound::render (see Sound::init_offline)
+
+	//block size (all game thread):
+	uint32_t block_frames = 0; //size the device is currently using
+	uint32_t requested_block_frames = 1024; //size asked for by init/set_block_size
+	uint32_t given_block_frames = 0; //size the device gave when asked for requested_block_frames (recovery stops here)
+	bool adaptive_block_frames = true;
+	bool can_grow_block = true, can_shrink_block = true; //cleared once a reopen doesn't change the size (or fails)
+	uint64_t backoff_overruns = 0; //value of stat_overruns at the start of the current window
+	uint32_t backoff_window_start = 0; //SDL_GetTicks() at start of current window
+	uint32_t backoff_quiet_since = 0; //SDL_GetTicks() at last block size change or window with overruns
+
+	//inner mixing loops (picked in Sound::init based on what the CPU supports):
+	MixMonoFn mix_mono = nullptr;
+	MixStereoFn mix_stereo = nullptr;
+	SynthToneFn synth_tone = nullptr;
+	ResampleFn resample_mono = nullptr;
+	ResampleFn resample_stereo = nullptr;
+
+	//resampling (see resample_voice):
+	constexpr float const MIN_PITCH = 1.0f / 64.0f; //(limits on the ratio of source frames to output frames)
+	constexpr float const MAX_PITCH = 8.0f;
+	constexpr uint32_t const RESAMPLE_EDGE_FRAMES = 256; //output frames per piece near the ends of a sample
+	//source frames copied out (wrapped or padded with silence) near the ends of a sample, so the filter can read past them:
+	std::vector< float > resample_edge;
+
+	//---- buses ----
+	//Voices are mixed into their bus's block of audio, which then goes through the bus's effects and
+	// is added to the output with the bus's gain (see mix_buses):
+	struct BusSlot {
+		Sound::Effect::Type type = Sound::Effect::None;
+		LowPassEffect low_pass;
+		ReverbEffect reverb;
+	};
+	struct BusState {
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		Sound::Ramp< float > mute = Sound::Ramp< float >(1.0f); //(0 when muted)
+		Sound::Ramp< float > duck = Sound::Ramp< float >(1.0f);
+		BusSlot slots[Sound::EffectSlots];
+		float *out = nullptr; //this block's audio: interleaved stereo, with room for MAX_MIX_SAMPLES frames
+		bool used = false; //some voice was mixed into 'out' this block
+		//sidechain triggers (voices of samples with 'ducks' set) are mixed here first, so they can be measured:
+		float *key = nullptr; //(same size as 'out')
+		bool keyed = false; //some trigger voice was mixed into 'key' this block
+		//this bus's sidechain, if any (see run_sidechains):
+		bool sidechained = false;
+		float sidechain_depth = 0.0f; //1 - Sidechain::level
+		float sidechain_threshold = 1.0f;
+		float attack_coef = 1.0f, release_coef = 1.0f; //fraction of the way the envelope moves each frame
+		float envelope = 0.0f; //trigger loudness, as followed so far
+		float *sidechain_gain = nullptr; //per-frame gain for this block (MAX_MIX_SAMPLES floats)
+		bool ducking = false; //sidechain_gain isn't all 1.0 this block
+	};
+	BusState buses[Sound::BusCount];
+	float *key_level = nullptr; //per-frame loudness of all trigger voices this block (MAX_MIX_SAMPLES floats; in mix_arena)
+
+	//the finished mix goes through this on its way to the device (see Sound::set_limiter):
+	Limiter limiter;
+	static_assert(Limiter::Lookahead == Sound::LimiterLatency, "Sound.hpp should advertise the limiter's actual latency");
+
+	//the mixer's per-block scratch space and effect state all come out of this one allocation (made in
+	// init_voices), so the callback never allocates -- however many buses and effects are in use:
+	struct MixArena {
+		std::vector< float > memory;
+		size_t used = 0;
+		void reset(size_t size) {
+			memory.assign(size, 0.0f);
+			used = 0;
+		}
+		float *take(size_t count) {
+			assert(used + count <= memory.size());
+			float *ret = memory.data() + used;
+			used += count;
+			return ret;
+		}
+	};
+	MixArena mix_arena;
+
+	//---- streaming ----
+	//Streamed samples are decoded by a background thread into a ring of blocks, which the mixer reads from:
+	// (the same thread also decodes Cached samples passed to Sound::prefetch)
+	constexpr uint32_t const STREAM_BLOCK_FRAMES = 2048;
+	constexpr uint32_t const STREAM_BLOCKS = 16; //(so about 0.7 seconds is decoded ahead of playback)
+
+	struct StreamBlock {
+		float data[2 * STREAM_BLOCK_FRAMES]; //(room for stereo; mono streams only use the first half)
+		uint32_t frames = 0;
+		uint32_t epoch = 0; //which seek this block was decoded after (older blocks are skipped by the mixer)
+		bool last = false; //block ends at the end of the file (the next block starts over from the beginning)
+	};
+
+	//all streamed samples, visited by the decode thread:
+	std::mutex streams_mutex;
+	std::vector< Sound::SampleStream * > streams;
+	std::thread stream_thread;
+	bool stream_thread_quit = false; //(protected by streams_mutex)
+	std::condition_variable stream_thread_wake;
+
+	//scratch space the mixer copies streamed audio into:
+	std::vector< float > stream_scratch;
+
+	//---- cache ----
+	//Cached samples are decoded into a shared pool, tracked here (everything protected by cache_mutex):
+	std::mutex cache_mutex;
+	std::condition_variable cache_prefetched; //signalled when the decode thread finishes (or abandons) a prefetch
+	std::vector< Sound::CacheEntry * > cache_entries; //every Cached sample
+	std::vector< Sound::CacheEntry * > cache_prefetch; //prefetch requests, oldest first
+	size_t cache_budget = size_t(32) << 20;
+	size_t cache_resident = 0; //bytes of decoded audio in Resident entries
+	uint64_t cache_clock = 0; //bumped on every use, for least-recently-used eviction
+	constexpr uint32_t const PREFETCH_CHUNK_FRAMES = AUDIO_RATE / 4; //decoded per pass of the decode thread, so streams aren't starved
+
+	//---- voice pool ----
+	//Every playing sample occupies one slot of a fixed-size pool, allocated in Sound::init().
+	//Each slot has a 'generation' counter; whoever successfully bumps it takes the slot away
+	// from the previous generation:
+	//  - the mixer bumps it when a voice finishes, and hands the slot back through 'reclaimed_voices';
+	//  - the game thread bumps it when it steals a busy voice.
+	//A PlayingSample handle is (index, generation), so stale handles are easy to detect.
+
+	//state shared between the game thread and the mixer:
+	struct VoiceSlot {
+		std::atomic< uint32_t > generation{0};
+		std::atomic< float > level{0.0f}; //current volume, published by the mixer (used by StealQuietest)
+	};
+	std::unique_ptr< VoiceSlot[] > voice_slots;
+	uint32_t voice_limit = 0;
+
+	//state only touched by the mixer:
+	struct Voice {
+		float const *data = nullptr; //sample data being played
+		uint32_t size = 0; //length of sample data, in frames
+		uint32_t channels = 1; //values per frame (1 or 2)
+		uint32_t i = 0; //next frame to read
+		uint32_t frac = 0; //...plus this fraction of a frame (in 1/2^32ths), when resampling
+		uint32_t rate = AUDIO_RATE; //frames per second of 'data'
+		Sound::SampleStream *stream = nullptr; //...or stream being played
+		bool synth = false; //...or generate audio from 'tone' (frames [0,size) of it) as it plays
+		Sound::Tone tone;
+		uint32_t bus = Sound::BusSFX; //bus this voice is mixed into
+		bool trigger = false; //ducks sidechained buses
+		Sound::CacheEntry *cached = nullptr; //cache entry 'data' belongs to (unpinned once the voice is done with it)
+		uint32_t stream_epoch = 0; //blocks from before this seek are skipped
+		uint32_t block_offset = 0; //next frame to read in current stream block
+		uint32_t generation = 0; //generation this voice was started with
+		uint64_t start_at = 0; //mixer clock frame to start playing at
+		uint64_t stop_at = NoTime; //mixer clock frame to start fading out at...
+		float stop_ramp = 0.0f; //...and how long to fade for
+		bool active = false;
+		bool loop = false; //jump back to 'loop_start' when 'loop_end' is reached
+		uint32_t loop_start = 0, loop_end = 0; //(frames; loop_end <= size; not used for streams, which loop as they decode)
+		bool stopping = false; //fading out because of stop()
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		Sound::Ramp< float > pan = Sound::Ramp< float >(0.0f);
+		Sound::Ramp< float > pitch = Sound::Ramp< float >(1.0f);
+	};
+	std::vector< Voice > voices; //indexed by slot
+	std::vector< uint32_t > active_voices; //slots of active voices (capacity voice_limit, so never reallocates)
+
+	//gains for each entry of active_voices, worked out for the whole block in one pass before mixing
+	// (see compute_block_gains); kept as separate arrays (sized voice_limit) so that pass is a short loop over floats:
+	struct BlockGains {
+		std::vector< float > pan[2], volume[2]; //at start and end of block
+		std::vector< uint8_t > stereo;
+		std::vector< uint8_t > whole; //plays for the whole block (if not, mix_voice works out gains for each part it plays)
+		std::vector< float > start_l, start_r, step_l, step_r;
+		std::vector< float > peak; //largest of the per-channel gains over the block (for spotting inaudible voices)
+
+		void resize(uint32_t size) {
+			for (auto v : {&pan[0], &pan[1], &volume[0], &volume[1], &start_l, &start_r, &step_l, &step_r, &peak}) v->assign(size, 0.0f);
+			stereo.assign(size, 0);
+			whole.assign(size, 0);
+		}
+		//(used when active_voices is reordered)
+		void move(uint32_t from, uint32_t to) {
+			whole[to] = whole[from];
+			start_l[to] = start_l[from];
+			start_r[to] = start_r[from];
+			step_l[to] = step_l[from];
+			step_r[to] = step_r[from];
+			peak[to] = peak[from];
+		}
+	};
+	BlockGains block_gains;
+
+	//a voice whose gain (along with its bus's and the global volume) stays below this for a whole block can't be heard,
+	// so for that block it is "virtual": its place in the sample moves along, but nothing is read or mixed (see skip_voice_frames)
+	constexpr float const INAUDIBLE_GAIN = 3.2e-5f; //(-90dB -- about one step of 16-bit audio)
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//equal-power pan law, tabulated at compile time: pan_table.left[i] is the left gain at pan = -1 + 2 * i / PAN_TABLE_SIZE
+	// (the right gain is the same curve mirrored; compute_pan_weights interpolates between entries)
+	constexpr uint32_t const PAN_TABLE_SIZE = 256;
+	constexpr double taylor_cos(double x) {
+		//(only used for x in [0, pi/2], where this many terms is far more than float precision needs)
+		double term = 1.0;
+		double sum = 1.0;
+		for (uint32_t k = 1; k < 12; ++k) {
+			term *= -x * x / double((2 * k - 1) * (2 * k));
+			sum += term;
+		}
+		return sum;
+	}
+	struct PanTable {
+		float left[PAN_TABLE_SIZE + 2] = {}; //(one extra entry, so interpolating at pan = 1 stays in bounds)
+		constexpr PanTable() {
+			for (uint32_t i = 0; i <= PAN_TABLE_SIZE; ++i) {
+				left[i] = float(taylor_cos(0.5 * 3.14159265358979323846 * double(i) / double(PAN_TABLE_SIZE)));
+			}
+			left[PAN_TABLE_SIZE] = 0.0f;
+			left[PAN_TABLE_SIZE + 1] = 0.0f;
+		}
+	};
+	constexpr PanTable const pan_table;
+
+	//state only touched by the game thread:
+	struct VoiceOwner {
+		uint32_t generation = 0; //generation most recently handed out for this slot
+		bool in_use = false; //not in free_voices
+		bool stop_requested = false; //stop() was called for this generation
+		uint32_t priority = 0;
+		uint64_t started = 0; //value of play_counter when started
+		Sound::SampleStream *stream = nullptr; //stream being played (used by seek)
+		bool pending = false; //Play command is waiting for a Cached sample to decode (see pending_plays)
+	};
+	std::vector< VoiceOwner > voice_owners;
+	std::vector< uint32_t > free_voices;
+	uint64_t play_counter = 0;
+	Sound::StealPolicy steal_policy = Sound::StealOldest;
+
+	//slots finished by the mixer, on their way back to the game thread:
+	struct Reclaimed {
+		uint32_t index = 0;
+		uint32_t generation = 0; //slot generation after the mixer released it
+	};
+	std::unique_ptr< SPSCRing< Reclaimed > > reclaimed_voices;
+
+	//commands from the game thread to the audio callback:
+	struct Command {
+		enum Type : uint32_t {
+			Play, //start voice 'index' playing 'data' at 'when' (fading in over 'ramp')
+			Stop, //fade out voice over 'ramp', starting at 'when'
+			SetVolume, //ramp volume of voice to 'volume'
+			SetPan, //ramp pan of voice to 'pan'
+			SetPitch, //ramp pitch of voice to 'pitch'
+			Seek, //move voice to 'position' (or, for streams, start reading from 'epoch')
+			SetGlobalVolume, //ramp Sound::volume to 'volume'
+			StopAll, //fade out every playing voice
+			SetBusVolume, //ramp volume of 'bus' to 'volume'
+			SetBusMute, //ramp mute gain of 'bus' to 'volume' (0 == muted, 1 == not)
+			SetBusDuck, //ramp duck level of 'bus' to 'volume'
+			SetBusEffect, //put 'effect' in effect slot 'index' of 'bus'
+			SetSidechain, //set up 'sidechain' on 'bus' (or remove it, if 'loop' is false)
+			SetLimiter, //limit output to 'volume', releasing over 'ramp' (or don't limit, if 'loop' is false)
+		} type = Play;
+		uint32_t index = 0; //voice slot (or effect slot, for SetBusEffect)
+		uint32_t generation = 0; //commands for stale generations are ignored
+		float const *data = nullptr;
+		uint32_t size = 0;
+		uint32_t channels = 1;
+		uint32_t rate = AUDIO_RATE;
+		Sound::SampleStream *stream = nullptr;
+		Sound::CacheEntry *cached = nullptr;
+		bool synth = false;
+		Sound::Tone tone;
+		uint32_t bus = Sound::BusSFX;
+		bool trigger = false;
+		Sound::Effect effect;
+		Sound::Sidechain sidechain;
+		uint32_t epoch = 0;
+		uint32_t position = 0;
+		uint64_t when = 0; //mixer clock frame (0 == as soon as possible)
+		bool loop = false;
+		uint32_t loop_start = 0, loop_end = 0;
+		float volume = 1.0f;
+		float pan = 0.0f;
+		float pitch = 1.0f;
+		float ramp = 0.0f;
+	};
+	SPSCRing< Command > commands(COMMAND_RING_SIZE);
+
+	//plays of Cached samples whose audio is still being decoded by the decode thread (game thread only):
+	// (these are sent to the mixer by start_pending_plays, called from Sound::update, once decoding finishes)
+	struct PendingPlay {
+		Command play; //(everything but 'data', 'size', and the loop points, which need the decoded audio)
+		Sound::LoopPoints points;
+		std::vector< Command > after; //commands sent to the voice while it waited, to follow the Play
+	};
+	std::vector< PendingPlay > pending_plays;
+
+	//counters reported through Sound::get_stats():
+	std::atomic< uint64_t > stat_callbacks{0};
+	std::atomic< uint64_t > stat_overruns{0};
+	std::atomic< uint64_t > stat_dropped_commands{0};
+	std::atomic< uint64_t > stat_stolen_voices{0};
+	std::atomic< uint64_t > stat_stream_underruns{0};
+	std::atomic< float > stat_max_callback_ms{0.0f};
+	uint64_t stat_cache_hits = 0; //(these three protected by cache_mutex)
+	uint64_t stat_cache_misses = 0;
+	uint64_t stat_cache_evictions = 0;
+
+	//per-callback histograms, also reported through Sound::get_stats():
+	// (written only by the audio callback, read by anyone -- so plain relaxed atomics are enough)
+	struct StatHistogram {
+		std::atomic< uint64_t > counts[Sound::Histogram::Bins] = {};
+		void add(uint32_t bin) { counts[bin].fetch_add(1, std::memory_order_relaxed); }
+	};
+	//microsecond histograms use power-of-two bins: [0,16), [16,32), [32,64), ... [262144, inf):
+	constexpr float const HISTOGRAM_FIRST_US = 16.0f;
+	uint32_t us_bin(float us) {
+		uint32_t bin = 0;
+		for (float edge = HISTOGRAM_FIRST_US; us >= edge && bin + 1 < Sound::Histogram::Bins; edge *= 2.0f) ++bin;
+		return bin;
+	}
+	float us_bin_lower(uint32_t bin) {
+		return (bin == 0 ? 0.0f : HISTOGRAM_FIRST_US * float(1U << (bin - 1)));
+	}
+	//utilization histogram uses 10% bins: [0,10), [10,20), ... [150, inf):
+	uint32_t percent_bin(float percent) {
+		return std::min(Sound::Histogram::Bins - 1, uint32_t(std::max(0.0f, percent) / 10.0f));
+	}
+	float percent_bin_lower(uint32_t bin) {
+		return 10.0f * bin;
+	}
+
+	StatHistogram stat_callback_us;
+	StatHistogram stat_utilization;
+	StatHistogram stat_jitter_us;
+	std::atomic< uint32_t > stat_peak_voices{0};
+	std::atomic< uint64_t > stat_voice_callbacks{0}; //sum of voices in use over all callbacks (for the average)
+	std::atomic< uint64_t > stat_virtual_voice_callbacks{0}; //...and of voices skipped as inaudible
+	std::atomic< uint64_t > stat_clipped_samples{0};
+	std::atomic< uint64_t > stat_clipped_callbacks{0};
+	//gain reduction histogram uses 1dB bins: [0,1), [1,2), ... [15, inf):
+	uint32_t db_bin(float db) {
+		return std::min(Sound::Histogram::Bins - 1, uint32_t(std::max(0.0f, db)));
+	}
+	float db_bin_lower(uint32_t bin) {
+		return float(bin);
+	}
+	StatHistogram stat_gain_reduction_db;
+	std::atomic< uint64_t > stat_limited_frames{0};
+	std::atomic< uint64_t > stat_limited_callbacks{0};
+	std::atomic< float > stat_max_gain_reduction_db{0.0f};
+	Uint64 last_callback_start = 0; //(audio callback only; 0 == no previous callback to measure jitter from)
+
+	std::string stats_file; //written by Sound::shutdown, if set (game thread)
 
 }
 
+//(declared in Sound.hpp so Sample can hold one)
+struct Sound::SampleStream {
+	SampleStream(std::string const &filename) : opus(filename), blocks(STREAM_BLOCKS) { }
+	//stream from a file that is already in memory (e.g., in a Bundle):
+	SampleStream(std::string const &name, unsigned char const *data, size_t size) : opus(name, data, size), blocks(STREAM_BLOCKS) { }
+
+	OpusStream opus; //(decode thread)
+	SPSCRing< StreamBlock > blocks; //decode thread -> mixer
+
+	//seeking: the game thread sets 'seek_to' then bumps 'epoch':
+	std::atomic< uint64_t > seek_to{0};
+	std::atomic< uint32_t > epoch{0};
+	//looping: after 'loop_end' (or the end of the file, if it is 0), decoding continues from 'loop_start'
+	// (also set by the game thread before bumping 'epoch'; both are 0 when the voice isn't looping)
+	std::atomic< uint64_t > loop_start{0};
+	std::atomic< uint64_t > loop_end{0};
+
+	uint32_t decoded_epoch = 0; //(decode thread) epoch of blocks currently being decoded
+	uint64_t decoded_frame = 0; //(decode thread) file position of the next frame to decode
+	uint64_t decode_loop_start = 0, decode_loop_end = 0; //(decode thread) loop points for the current epoch
+	bool failed = false; //(decode thread) decoding threw an exception; don't try again
+	bool played = false; //(game thread) has playback started since the last seek?
+	uint32_t voice = -1U; //(mixer) voice currently reading from this stream
+};
+
+//(declared in Sound.hpp so Sample can hold one)
+struct Sound::CacheEntry {
+	CacheEntry(std::string const &filename);
+	//use a file that is already in memory (e.g., in a Bundle) instead of reading a copy ('data' must outlive this):
+	CacheEntry(std::string const &name, unsigned char const *data, size_t size);
+	//(helper for the constructors) check the file decodes, and fill in 'channels' and 'length':
+	void probe();
+
+	std::string filename;
+	std::vector< unsigned char > opus_data; //compressed file contents (kept for the life of the sample)...
+	unsigned char const *opus = nullptr; //...which are here (either opus_data or a file already in memory)
+	size_t opus_size = 0;
+	uint32_t channels = 1;
+	uint64_t length = 0; //in frames
+
+	enum State {
+		Compressed, //nothing decoded
+		Queued, //waiting in cache_prefetch
+		Prefetching, //being decoded by the decode thread
+		Resident, //'pcm' holds the whole sample
+	} state = Compressed; //(cache_mutex)
+	std::vector< float > pcm; //decoded audio; only touched by whoever is decoding, or once Resident
+	std::unique_ptr< OpusStream > decoder; //(decode thread) while Prefetching
+	uint64_t last_used = 0; //(cache_mutex) value of cache_clock when last played or prefetched
+
+	//voices reading 'pcm' (plus Play commands on their way to the mixer or waiting in pending_plays); entries with pins are never evicted:
+	// incremented by the game thread, decremented by the mixer when a voice stops reading
+	std::atomic< uint32_t > pins{0};
+};
+
 //public-facing data:
 
 //global volume control:
@@ -32,41 +457,373 @@ Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
 
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
+uint64_t voice_resample_step(Voice const &voice);
+bool mix_voice_frames(Voice &voice, float *out, uint32_t frames, float start_l, float start_r, float step_l, float step_r);
+uint32_t resample_voice(Voice &voice, uint64_t step, float *out, uint32_t frames, bool *finished);
+bool skip_voice_frames(Voice &voice, uint32_t frames);
+
+//game-thread side of the command ring; never waits for the callback (returns false and drops the command if the ring is full):
+bool push_command(Command const &command);
+
+void stream_thread_main();
+bool open_device(uint32_t frames);
+uint32_t resize_device(uint32_t frames);
+uint32_t round_block_frames(uint32_t frames);
+void init_voices(uint32_t voice_limit);
+void fill_streams();
+void fill_all_streams();
+void start_decode_thread();
+bool prefetch_step();
+void abandon_prefetch();
+void evict_cached(Sound::CacheEntry *keep);
+
+//game-thread side of the voice pool:
+uint32_t acquire_voice(bool *stole = nullptr);
+void release_unplayed_voice(uint32_t index);
+Sound::PlayingSample start_voice(Sound::Sample const &sample, float volume, float pan, uint32_t priority, bool loop, uint64_t when, float fade_in, float pitch = 1.0f, Sound::LoopPoints const &points = Sound::LoopPoints());
+Sound::PlayingSample start_tone(Sound::Tone const &tone, float volume, float pan, uint32_t priority, bool loop, uint64_t when, float fade_in, float pitch = 1.0f, Sound::LoopPoints const &points = Sound::LoopPoints(), Sound::Bus bus = Sound::BusSFX, bool trigger = false);
+void set_loop_points(Command *command, Sound::LoopPoints const &points);
+
+//bus helpers:
+void check_bus(Sound::Bus bus);
+void apply_bus_effect(BusSlot *slot, Sound::Effect const &effect);
+void apply_sidechain(BusState *bus, Sound::Sidechain const *sidechain);
+void run_sidechains(uint32_t frames);
+void mix_buses(float *out, uint32_t frames, float const block_volume[2]);
+
+//tone helpers:
+uint32_t tone_frames(Sound::Tone const &tone);
+void synthesize(SynthToneFn fn, Sound::Tone const &tone, uint32_t first, uint32_t count, float *out);
+
+//streaming helpers:
+void register_stream(Sound::SampleStream *stream);
+void unregister_stream(Sound::SampleStream *stream);
+void seek_stream(Sound::SampleStream *stream, uint64_t frame);
+
+//cache helpers:
+void register_cached(Sound::CacheEntry *entry);
+void unregister_cached(Sound::CacheEntry *entry);
+bool pin_cached(Sound::CacheEntry *entry);
+void start_pending_plays();
+void push_voice_command(Command const &command);
+void drop_pending_play(uint32_t at);
 
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
-	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+Sound::Sample::Sample(std::string const &filename, LoadMode load_mode) {
+	if (load_mode == Streamed) {
+		if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+			throw std::runtime_error("Sample '" + filename + "' can't be streamed -- only \".opus\" files can.");
+		}
+		stream.reset(new SampleStream(filename));
+		if (stream->opus.length() == 0) {
+			throw std::runtime_error("Sample '" + filename + "' is empty.");
+		}
+		channels = stream->opus.channels;
+		register_stream(stream.get());
+	} else if (load_mode == Cached) {
+		if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+			throw std::runtime_error("Sample '" + filename + "' can't be cached -- only \".opus\" files can.");
+		}
+		cached.reset(new CacheEntry(filename));
+		channels = cached->channels;
+		register_cached(cached.get());
+	} else if (load_mode == Mapped) {
+		if (!(filename.size() >= 4 && filename.substr(filename.size()-4) == ".pcm")) {
+			throw std::runtime_error("Sample '" + filename + "' can't be mapped -- only \".pcm\" files can.");
+		}
+		mapped.reset(new MappedPCM(filename));
+		channels = mapped->info.channels;
+		rate = mapped->info.rate;
+	} else if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
+		load_wav(filename, &data, &channels, &rate);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		load_opus(filename, &data, &channels);
+	} else if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".pcm") {
+		load_pcm(filename, &data, &channels, &rate);
+	} else {
+		throw std::runtime_error("Sample '" + filename + "' doesn't end in \".wav\", \".opus\", or \".pcm\" -- unsure how to load.");
+	}
+}
+
+Sound::Sample::Sample(Bundle const &bundle, std::string const &name, LoadMode load_mode) {
+	Bundle::Slice const &slice = bundle.get(name);
+	bool opus = (name.size() >= 5 && name.substr(name.size()-5) == ".opus");
+	bool pcm = (name.size() >= 4 && name.substr(name.size()-4) == ".pcm");
+	if (load_mode == Streamed) {
+		if (!opus) {
+			throw std::runtime_error("Sample '" + name + "' can't be streamed -- only \".opus\" files can.");
+		}
+		stream.reset(new SampleStream(name, slice.data, slice.size));
+		if (stream->opus.length() == 0) {
+			throw std::runtime_error("Sample '" + name + "' is empty.");
+		}
+		channels = stream->opus.channels;
+		register_stream(stream.get());
+	} else if (load_mode == Cached) {
+		if (!opus) {
+			throw std::runtime_error("Sample '" + name + "' can't be cached -- only \".opus\" files can.");
+		}
+		cached.reset(new CacheEntry(name, slice.data, slice.size));
+		channels = cached->channels;
+		register_cached(cached.get());
+	} else if (load_mode == Mapped) {
+		if (!pcm) {
+			throw std::runtime_error("Sample '" + name + "' can't be mapped -- only \".pcm\" files can.");
+		}
+		mapped.reset(new MappedPCM(name, slice.data, slice.size));
+		channels = mapped->info.channels;
+		rate = mapped->info.rate;
+	} else if (opus) {
+		load_opus(name, slice.data, slice.size, &data, &channels);
+	} else if (pcm) {
+		MappedPCM in_bundle(name, slice.data, slice.size);
+		data.assign(in_bundle.data, in_bundle.data + size_t(in_bundle.info.frames) * in_bundle.info.channels);
+		channels = in_bundle.info.channels;
+		rate = in_bundle.info.rate;
+	} else {
+		throw std::runtime_error("Sample '" + name + "' in bundle '" + bundle.filename + "' doesn't end in \".opus\" or \".pcm\" -- unsure how to load.");
+	}
+}
+
+Sound::Sample::Sample(std::vector< float > const &data_, uint32_t channels_, uint32_t rate_) : data(data_), channels(channels_), rate(rate_) {
+	if (rate == 0) {
+		throw std::runtime_error("Samples must have a sampling rate above zero.");
+	}
+	if (channels != 1 && channels != 2) {
+		throw std::runtime_error("Samples must have one or two channels, not " + std::to_string(channels) + ".");
+	}
+	if (data.size() % channels != 0) {
+		throw std::runtime_error("Stereo sample data must have an even number of values.");
+	}
+}
+
+Sound::Sample::Sample(Tone const &tone_, LoadMode load_mode) {
+	if (load_mode == Streamed) {
+		tone.reset(new Tone(tone_));
+	} else if (load_mode == Decoded) {
+		//(the mixer may not be set up yet, so pick a kernel here)
+		data.resize(tone_frames(tone_));
+		synthesize(get_synth_tone(best_mix_kernel()), tone_, 0, uint32_t(data.size()), data.data());
 	} else {
-		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
+		throw std::runtime_error("Tones can't be cached or mapped -- use Decoded to keep the generated audio around.");
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::~Sample() {
+	if (stream) unregister_stream(stream.get());
+	if (cached) unregister_cached(cached.get());
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (index >= voice_limit) return true;
+	if (voice_slots[index].generation.load(std::memory_order_acquire) != generation) return true; //finished or stolen
+	return voice_owners[index].stop_requested;
+}
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	if (index >= voice_limit) return;
+	Command command;
+	command.type = Command::SetVolume;
+	command.index = index;
+	command.generation = generation;
+	command.volume = new_volume;
+	command.ramp = ramp;
+	push_voice_command(command);
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	lock();
-	if (!stopped) {
-		stopped = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	if (index >= voice_limit) return;
+	Command command;
+	command.type = Command::SetPan;
+	command.index = index;
+	command.generation = generation;
+	command.pan = new_pan;
+	command.ramp = ramp;
+	push_voice_command(command);
+}
+
+void Sound::PlayingSample::set_pitch(float new_pitch, float ramp) const {
+	if (index >= voice_limit) return;
+	Command command;
+	command.type = Command::SetPitch;
+	command.index = index;
+	command.generation = generation;
+	command.pitch = new_pitch;
+	command.ramp = ramp;
+	push_voice_command(command);
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	stop_at(0, ramp);
+}
+
+void Sound::PlayingSample::stop_at(uint64_t mix_time, float ramp) const {
+	if (index >= voice_limit) return;
+	if (voice_slots[index].generation.load(std::memory_order_acquire) != generation) return;
+
+	//(recorded here so that stopped() changes right away)
+	voice_owners[index].stop_requested = true;
+
+	if (voice_owners[index].pending && mix_time == 0) {
+		//still waiting to be decoded, so it never has to start at all:
+		for (uint32_t i = 0; i < pending_plays.size(); ++i) {
+			if (pending_plays[i].play.index == index && pending_plays[i].play.generation == generation) {
+				drop_pending_play(i);
+				return;
+			}
+		}
+	}
+
+	Command command;
+	command.type = Command::Stop;
+	command.index = index;
+	command.generation = generation;
+	command.when = mix_time;
+	command.ramp = ramp;
+	push_voice_command(command);
+}
+
+void Sound::PlayingSample::seek(float time) const {
+	if (index >= voice_limit) return;
+	if (voice_slots[index].generation.load(std::memory_order_acquire) != generation) return;
+
+	uint64_t frame = uint64_t(std::max(0.0f, time) * AUDIO_RATE);
+
+	Command command;
+	command.type = Command::Seek;
+	command.index = index;
+	command.generation = generation;
+	if (SampleStream *stream = voice_owners[index].stream) {
+		seek_stream(stream, frame);
+		stream->played = true;
+		command.epoch = stream->epoch.load(std::memory_order_relaxed);
 	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
+		command.position = uint32_t(std::min< uint64_t >(frame, -1U));
 	}
-	unlock();
+	push_voice_command(command);
 }
 
 
-void Sound::init() {
+void Sound::init(uint32_t voice_limit_, uint32_t block_frames_) {
+	init_voices(voice_limit_);
+	MixKernel kernel = best_mix_kernel();
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 		return;
 	}
+	audio_initialized = true;
+
+	requested_block_frames = block_frames_;
+	if (open_device(requested_block_frames)) {
+		std::cout << "Audio output initialized (" << mix_kernel_name(kernel) << " mixing, " << block_frames << " frame blocks)." << std::endl;
+	} else {
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+	}
+	given_block_frames = block_frames;
+	can_grow_block = can_shrink_block = true;
+}
+
+void Sound::init_offline(uint32_t voice_limit_, uint32_t block_frames_) {
+	init_voices(voice_limit_);
+	offline = true;
+	requested_block_frames = block_frames_;
+	block_frames = round_block_frames(block_frames_);
+	std::cout << "Audio output initialized (offline, " << mix_kernel_name(best_mix_kernel()) << " mixing, " << block_frames << " frame blocks)." << std::endl;
+}
+
+void Sound::render(float *out, uint32_t frames) {
+	assert(offline && "Sound::render is only for use after Sound::init_offline");
+	while (frames > 0) {
+		uint32_t count = std::min(frames, block_frames);
+		//there's no decode thread, so do its work now (this also keeps the output deterministic):
+		fill_streams();
+		start_pending_plays();
+		mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), int(count * 2 * sizeof(float)));
+		out += 2 * count;
+		frames -= count;
+	}
+}
+
+//helper: allocate the voice pool and pick mixing kernels (used by both init functions):
+void init_voices(uint32_t voice_limit_) {
+	assert(voice_limit_ > 0 && "need at least one voice");
+
+	//commands sent after the mixer last ran (e.g., stopping voices just before a shutdown) -- and plays still waiting
+	// for the decode thread -- are for the old pool:
+	Command stale;
+	while (commands.pop(&stale)) {
+		if (stale.type == Command::Play && stale.cached) stale.cached->pins.fetch_sub(1, std::memory_order_release);
+	}
+	for (auto const &pending : pending_plays) {
+		pending.play.cached->pins.fetch_sub(1, std::memory_order_release);
+	}
+	pending_plays.clear();
+
+	//allocate the voice pool (all at once, so that playing never allocates):
+	voice_limit = voice_limit_;
+	voice_slots.reset(new VoiceSlot[voice_limit]);
+	voices.assign(voice_limit, Voice());
+	active_voices.clear();
+	active_voices.reserve(voice_limit);
+	voice_owners.assign(voice_limit, VoiceOwner());
+	free_voices.clear();
+	free_voices.reserve(voice_limit);
+	for (uint32_t i = voice_limit - 1; i < voice_limit; --i) {
+		free_voices.emplace_back(i);
+	}
+	reclaimed_voices.reset(new SPSCRing< Reclaimed >(4 * voice_limit));
+	block_gains.resize(voice_limit);
+	stream_scratch.assign(2 * MAX_MIX_SAMPLES, 0.0f);
+
+	//buses (with every effect slot able to hold the largest effect, so changing effects never allocates):
+	size_t const reverb_floats = ReverbEffect::memory_floats(float(AUDIO_RATE));
+	mix_arena.reset(MAX_MIX_SAMPLES + Sound::BusCount * (5 * MAX_MIX_SAMPLES + Sound::EffectSlots * reverb_floats) + Limiter::memory_floats(MAX_MIX_SAMPLES));
+	key_level = mix_arena.take(MAX_MIX_SAMPLES);
+	for (auto &bus : buses) {
+		bus = BusState();
+		bus.out = mix_arena.take(2 * MAX_MIX_SAMPLES);
+		bus.key = mix_arena.take(2 * MAX_MIX_SAMPLES);
+		bus.sidechain_gain = mix_arena.take(MAX_MIX_SAMPLES);
+		for (auto &slot : bus.slots) {
+			slot.reverb.attach(mix_arena.take(reverb_floats), float(AUDIO_RATE));
+		}
+	}
+
+	MixKernel kernel = best_mix_kernel();
+	mix_mono = get_mix_mono(kernel);
+	mix_stereo = get_mix_stereo(kernel);
+	synth_tone = get_synth_tone(kernel);
+	resample_mono = get_resample_mono(kernel);
+	resample_stereo = get_resample_stereo(kernel);
+
+	limiter.attach(mix_arena.take(Limiter::memory_floats(MAX_MIX_SAMPLES)), MAX_MIX_SAMPLES, get_frame_peak(kernel), get_apply_gain(kernel));
+	limiter.set(0.98f, 0.1f, float(AUDIO_RATE)); //(same as set_limiter's defaults)
+	resample_edge.assign(2 * (size_t(RESAMPLE_EDGE_FRAMES * MAX_PITCH) + RESAMPLE_BEFORE + RESAMPLE_AFTER + 2), 0.0f);
+	get_resample_table(1ULL << 32); //(builds the filter tables now, rather than in the audio callback)
+}
+
+//helper: round a block size to a power of two in the supported range:
+uint32_t round_block_frames(uint32_t frames) {
+	uint32_t rounded = MIN_MIX_SAMPLES;
+	while (rounded < frames && rounded < MAX_MIX_SAMPLES) rounded *= 2;
+	return rounded;
+}
+
+//helper: (re)open the audio device with a given block size; returns false (and leaves device == 0) on failure:
+// (the failure is reported, but it's up to the caller to say what happens next)
+bool open_device(uint32_t frames) {
+	if (device != 0) {
+		//(closing waits for any running callback to finish, so the mixer's state can be left as-is)
+		SDL_PauseAudioDevice(device, 1);
+		SDL_CloseAudioDevice(device);
+		device = 0;
+		block_frames = 0;
+	}
+
+	uint32_t want_frames = round_block_frames(frames);
 
 	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
 	SDL_AudioSpec want, have;
@@ -74,27 +831,134 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = Uint16(want_frames);
 	want.callback = mix_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//(the device may prefer a different block size; the mixer handles whatever it gets)
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		return false;
+	}
+	block_frames = have.samples;
+
+	//(devices open paused, so the callback isn't running yet and this is safe)
+	last_callback_start = 0; //(the gap while reopening isn't jitter)
+
+	backoff_overruns = stat_overruns.load(std::memory_order_relaxed);
+	backoff_window_start = backoff_quiet_since = SDL_GetTicks();
+
+	//start audio playback:
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+void Sound::set_block_size(uint32_t frames, bool adaptive) {
+	requested_block_frames = frames;
+	adaptive_block_frames = adaptive;
+	if (offline) {
+		block_frames = round_block_frames(frames);
+		return;
+	}
+	if (!audio_initialized) return;
+	if (open_device(frames)) {
+		std::cout << "Audio block size is now " << block_frames << " frames." << std::endl;
 	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+	}
+	given_block_frames = block_frames;
+	can_grow_block = can_shrink_block = true;
+}
+
+//helper: reopen the device with a new block size for Sound::update; returns the size it ended up with:
+// (the device may ignore the new size; if it won't reopen at all, the old size is tried again rather than leave audio off)
+uint32_t resize_device(uint32_t frames) {
+	uint32_t old_frames = block_frames;
+	if (!open_device(frames)) {
+		std::cerr << "  (Reopening with the old block size, " << old_frames << " frames, instead.)" << std::endl;
+		if (!open_device(old_frames)) {
+			std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		}
+	}
+	return block_frames;
+}
+
+void Sound::update() {
+	start_pending_plays();
+
+	if (device == 0 || !adaptive_block_frames) return;
+
+	uint32_t now = SDL_GetTicks();
+	uint64_t overruns = stat_overruns.load(std::memory_order_relaxed);
+	if (overruns - backoff_overruns >= BACKOFF_MISSES && block_frames < MAX_MIX_SAMPLES && can_grow_block) {
+		//the callback keeps missing its deadline; give it more time per block:
+		uint32_t missed = uint32_t(overruns - backoff_overruns);
+		uint32_t old_frames = block_frames;
+		uint32_t new_frames = resize_device(block_frames * 2);
+		if (device == 0) return; //(couldn't reopen at either size; already reported)
+		if (new_frames > old_frames) {
+			std::cout << "Audio callback missed " << missed << " deadlines; block size is now " << block_frames << " frames." << std::endl;
+			can_shrink_block = true;
+		} else {
+			//(the device picks its own size, or won't reopen at a larger one; trying again would just be another dropout)
+			std::cout << "Audio callback missed " << missed << " deadlines, but the block size can't be raised from " << old_frames << " frames." << std::endl;
+			can_grow_block = false;
+		}
+	} else if (block_frames > given_block_frames && can_shrink_block && overruns == backoff_overruns && now - backoff_quiet_since > RECOVER_MS) {
+		//quiet for a good while; try a smaller block again:
+		uint32_t old_frames = block_frames;
+		uint32_t new_frames = resize_device(block_frames / 2);
+		if (device == 0) return;
+		if (new_frames < old_frames) {
+			std::cout << "Audio block size is back down to " << block_frames << " frames." << std::endl;
+			can_grow_block = true;
+		} else {
+			can_shrink_block = false;
+		}
+	} else if (now - backoff_window_start > BACKOFF_WINDOW_MS && overruns - backoff_overruns < BACKOFF_MISSES) {
+		//start a new window (but keep counting toward recovery if there were no overruns at all):
+		if (overruns != backoff_overruns) backoff_quiet_since = now;
+		backoff_overruns = overruns;
+		backoff_window_start = now;
 	}
 }
 
 
 void Sound::shutdown() {
+	if (!stats_file.empty()) {
+		std::ofstream out(stats_file);
+		if (out) {
+			write_stats(out);
+			std::cout << "Wrote audio stats to '" << stats_file << "'." << std::endl;
+		} else {
+			std::cerr << "Failed to write audio stats to '" << stats_file << "'." << std::endl;
+		}
+	}
+
 	if (device != 0) {
 		//stop audio playback:
 		SDL_PauseAudioDevice(device, 1);
 		SDL_CloseAudioDevice(device);
 		device = 0;
+		block_frames = 0;
+	}
+	if (audio_initialized) {
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+		audio_initialized = false;
+	}
+	if (offline) {
+		offline = false;
+		block_frames = 0;
+	}
+
+	//stop decoding streams:
+	if (stream_thread.joinable()) {
+		{
+			std::lock_guard< std::mutex > lock(streams_mutex);
+			stream_thread_quit = true;
+		}
+		stream_thread_wake.notify_one();
+		stream_thread.join();
 	}
 }
 
@@ -107,141 +971,1579 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float pan, float volume) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, pan, volume);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan, uint32_t priority, float pitch) {
+	return start_voice(sample, volume, pan, priority, false, 0, 0.0f, pitch);
+}
+
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan, uint32_t priority, float pitch) {
+	return start_voice(sample, volume, pan, priority, true, 0, 0.0f, pitch);
+}
+
+Sound::PlayingSample Sound::loop(Sample const &sample, LoopPoints const &points, float volume, float pan, uint32_t priority, float pitch) {
+	return start_voice(sample, volume, pan, priority, true, 0, 0.0f, pitch, points);
+}
+
+Sound::PlayingSample Sound::play(Tone const &tone, float volume, float pan, uint32_t priority) {
+	return start_tone(tone, volume, pan, priority, false, 0, 0.0f);
+}
+
+uint64_t Sound::mix_clock() {
+	return mix_clock_frames.load(std::memory_order_acquire);
+}
+
+Sound::PlayingSample Sound::play_at(Sample const &sample, uint64_t mix_time, float volume, float pan, uint32_t priority) {
+	return start_voice(sample, volume, pan, priority, false, mix_time, 0.0f);
+}
+
+Sound::PlayingSample Sound::loop_at(Sample const &sample, uint64_t mix_time, float volume, float pan, uint32_t priority, LoopPoints const &points) {
+	return start_voice(sample, volume, pan, priority, true, mix_time, 0.0f, 1.0f, points);
+}
+
+Sound::PlayingSample Sound::crossfade(PlayingSample const &from, Sample const &to, uint64_t mix_time, float duration, float volume, bool loop, LoopPoints const &points) {
+	from.stop_at(mix_time, duration);
+	return start_voice(to, volume, 0.0f, 0, loop, mix_time, duration, 1.0f, points);
+}
+
+void Sound::set_steal_policy(StealPolicy policy) {
+	steal_policy = policy;
+}
+
+void Sound::prefetch(Sample const &sample) {
+	CacheEntry *entry = sample.cached.get();
+	if (!entry) return;
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		entry->last_used = ++cache_clock; //(about to be used, so don't evict it)
+		if (entry->state != CacheEntry::Compressed) return;
+		entry->state = CacheEntry::Queued;
+		cache_prefetch.emplace_back(entry);
+	}
+	//wake (or start) the decode thread:
+	std::lock_guard< std::mutex > lock(streams_mutex);
+	start_decode_thread();
+	stream_thread_wake.notify_one();
 }
 
+void Sound::set_cache_budget(size_t bytes) {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	cache_budget = bytes;
+	evict_cached(nullptr);
+}
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+	while (!pending_plays.empty()) {
+		drop_pending_play(uint32_t(pending_plays.size() - 1));
 	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	push_command(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.volume = new_volume;
+	command.ramp = ramp;
+	push_command(command);
 }
 
+//helper: check a bus number passed in by the game:
+void check_bus(Sound::Bus bus) {
+	if (uint32_t(bus) >= Sound::BusCount) {
+		throw std::runtime_error("There is no bus " + std::to_string(uint32_t(bus)) + " (there are " + std::to_string(Sound::BusCount) + ").");
+	}
+}
 
-//------------------------ internals --------------------------------
+void Sound::set_bus_volume(Bus bus, float new_volume, float ramp) {
+	check_bus(bus);
+	Command command;
+	command.type = Command::SetBusVolume;
+	command.bus = bus;
+	command.volume = new_volume;
+	command.ramp = ramp;
+	push_command(command);
+}
 
+void Sound::set_bus_muted(Bus bus, bool muted, float ramp) {
+	check_bus(bus);
+	Command command;
+	command.type = Command::SetBusMute;
+	command.bus = bus;
+	command.volume = (muted ? 0.0f : 1.0f);
+	command.ramp = ramp;
+	push_command(command);
+}
 
-//helper: equal-power panning
-inline void compute_pan_weights(float pan, float *left, float *right) {
-	//clamp pan to -1 to 1 range:
-	pan = std::max(-1.0f, std::min(1.0f, pan));
+void Sound::set_bus_duck(Bus bus, float level, float ramp) {
+	check_bus(bus);
+	Command command;
+	command.type = Command::SetBusDuck;
+	command.bus = bus;
+	command.volume = level;
+	command.ramp = ramp;
+	push_command(command);
+}
 
-	//want left^2 + right^2 = 1.0, so use angles:
-	float ang = 0.5f * 3.1415926f * (0.5f * (pan + 1.0f));
-	*left = std::cos(ang);
-	*right = std::sin(ang);
+void Sound::set_sidechain(Bus bus, Sidechain const &sidechain) {
+	check_bus(bus);
+	Command command;
+	command.type = Command::SetSidechain;
+	command.bus = bus;
+	command.sidechain = sidechain;
+	command.loop = true;
+	push_command(command);
 }
 
-//helper: ramp update for single values:
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
-		ramp.value = ramp.target;
-		ramp.ramp = 0.0f;
-	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+void Sound::clear_sidechain(Bus bus) {
+	check_bus(bus);
+	Command command;
+	command.type = Command::SetSidechain;
+	command.bus = bus;
+	command.loop = false;
+	push_command(command);
+}
+
+void Sound::set_limiter(bool enabled, float ceiling, float release) {
+	Command command;
+	command.type = Command::SetLimiter;
+	command.loop = enabled;
+	command.volume = ceiling;
+	command.ramp = release;
+	push_command(command);
+}
+
+void Sound::set_bus_effect(Bus bus, uint32_t slot, Effect const &effect) {
+	check_bus(bus);
+	if (slot >= EffectSlots) {
+		throw std::runtime_error("There is no effect slot " + std::to_string(slot) + " (buses have " + std::to_string(EffectSlots) + ").");
 	}
+	Command command;
+	command.type = Command::SetBusEffect;
+	command.bus = bus;
+	command.index = slot;
+	command.effect = effect;
+	push_command(command);
 }
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
-	assert(buffer_); //should always have some audio buffer
+Sound::Stats Sound::get_stats() {
+	Stats stats;
+	stats.callbacks = stat_callbacks.load(std::memory_order_relaxed);
+	stats.overruns = stat_overruns.load(std::memory_order_relaxed);
+	stats.dropped_commands = stat_dropped_commands.load(std::memory_order_relaxed);
+	stats.stolen_voices = stat_stolen_voices.load(std::memory_order_relaxed);
+	stats.stream_underruns = stat_stream_underruns.load(std::memory_order_relaxed);
+	stats.max_callback_ms = stat_max_callback_ms.load(std::memory_order_relaxed);
+	stats.block_frames = block_frames;
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		stats.cache_hits = stat_cache_hits;
+		stats.cache_misses = stat_cache_misses;
+		stats.cache_evictions = stat_cache_evictions;
+		stats.cache_resident_bytes = cache_resident;
+	}
 
-	struct LR {
-		float l;
-		float r;
+	auto copy_histogram = [](StatHistogram const &from, float (*lower)(uint32_t), Histogram *to) {
+		for (uint32_t b = 0; b < Histogram::Bins; ++b) {
+			to->lower[b] = lower(b);
+			to->counts[b] = from.counts[b].load(std::memory_order_relaxed);
+		}
 	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
-
-	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		buffer[s].l = 0.0f;
-		buffer[s].r = 0.0f;
+	copy_histogram(stat_callback_us, us_bin_lower, &stats.callback_us);
+	copy_histogram(stat_utilization, percent_bin_lower, &stats.utilization);
+	copy_histogram(stat_jitter_us, us_bin_lower, &stats.jitter_us);
+	stats.peak_voices = stat_peak_voices.load(std::memory_order_relaxed);
+	if (stats.callbacks) {
+		stats.average_voices = float(double(stat_voice_callbacks.load(std::memory_order_relaxed)) / double(stats.callbacks));
+		stats.average_virtual_voices = float(double(stat_virtual_voice_callbacks.load(std::memory_order_relaxed)) / double(stats.callbacks));
 	}
+	stats.clipped_samples = stat_clipped_samples.load(std::memory_order_relaxed);
+	stats.clipped_callbacks = stat_clipped_callbacks.load(std::memory_order_relaxed);
+	stats.limited_frames = stat_limited_frames.load(std::memory_order_relaxed);
+	stats.limited_callbacks = stat_limited_callbacks.load(std::memory_order_relaxed);
+	stats.max_gain_reduction_db = stat_max_gain_reduction_db.load(std::memory_order_relaxed);
+	copy_histogram(stat_gain_reduction_db, db_bin_lower, &stats.gain_reduction_db);
+	return stats;
+}
 
-	//update global values:
-	float start_volume = Sound::volume.value;
-	step_value_ramp(Sound::volume);
-	float end_volume = Sound::volume.value;
+void Sound::write_stats(std::ostream &to) {
+	Stats stats = get_stats();
+	to << "callbacks: " << stats.callbacks << " (" << stats.overruns << " overruns, longest " << stats.max_callback_ms << " ms)\n";
+	to << "block size: " << stats.block_frames << " frames\n";
+	to << "voices: peak " << stats.peak_voices << ", average " << stats.average_voices << " (" << stats.average_virtual_voices << " inaudible; limit " << voices.size() << ")\n";
+	to << "clipped samples: " << stats.clipped_samples << " (in " << stats.clipped_callbacks << " callbacks)\n";
+	to << "limited frames: " << stats.limited_frames << " (in " << stats.limited_callbacks << " callbacks, at most " << stats.max_gain_reduction_db << " dB)\n";
+	to << "commands dropped: " << stats.dropped_commands << ", voices stolen: " << stats.stolen_voices << ", stream underruns: " << stats.stream_underruns << "\n";
+	to << "cache: " << stats.cache_hits << " hits, " << stats.cache_misses << " misses, " << stats.cache_evictions << " evictions, " << stats.cache_resident_bytes << " bytes resident\n";
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	auto write_histogram = [&to](char const *name, Histogram const &histogram) {
+		uint64_t total = histogram.total();
+		to << name << " (median " << histogram.percentile(0.5f) << ", 99% " << histogram.percentile(0.99f) << "):\n";
+		for (uint32_t b = 0; b < Histogram::Bins; ++b) {
+			if (histogram.counts[b] == 0) continue;
+			to << "  [" << histogram.lower[b] << ", ";
+			if (b + 1 < Histogram::Bins) to << histogram.lower[b+1] << ")";
+			else to << "inf)";
+			to << ": " << histogram.counts[b] << " (" << (100.0 * double(histogram.counts[b]) / double(total)) << "%)\n";
+		}
+	};
+	write_histogram("callback time (us)", stats.callback_us);
+	write_histogram("callback time (% of block)", stats.utilization);
+	write_histogram("callback jitter (us)", stats.jitter_us);
+	write_histogram("limiter gain reduction (dB)", stats.gain_reduction_db);
+}
 
-		//Figure out sample panning/volume at start...
-		LR start_pan;
-		compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+void Sound::set_stats_file(std::string const &filename) {
+	stats_file = filename;
+}
 
-		step_value_ramp(playing_sample.pan);
-		step_value_ramp(playing_sample.volume);
+uint64_t Sound::Histogram::total() const {
+	uint64_t sum = 0;
+	for (uint32_t b = 0; b < Bins; ++b) sum += counts[b];
+	return sum;
+}
 
-		//..and end of the mix period:
-		LR end_pan;
-		compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+float Sound::Histogram::percentile(float fraction) const {
+	uint64_t want = uint64_t(std::ceil(double(fraction) * double(total())));
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b + 1 < Bins; ++b) {
+		seen += counts[b];
+		if (seen >= want) return lower[b+1];
+	}
+	return lower[Bins-1]; //(in the open-ended last bin, so this is the best that can be said)
+}
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
 
-		assert(playing_sample.i < playing_sample.data.size());
+//------------------------ internals --------------------------------
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+bool push_command(Command const &command) {
+	if (!commands.push(command)) {
+		//ring is full (callback stalled or not running); rather than wait, drop the command:
+		stat_dropped_commands.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				break;
-			}
+//helper: pick a busy voice to take over (game thread):
+uint32_t pick_victim() {
+	uint32_t best = 0;
+	for (uint32_t i = 1; i < voice_limit; ++i) {
+		VoiceOwner const &a = voice_owners[i];
+		VoiceOwner const &b = voice_owners[best];
+		bool better = false;
+		if (steal_policy == Sound::StealQuietest) {
+			float la = voice_slots[i].level.load(std::memory_order_relaxed);
+			float lb = voice_slots[best].level.load(std::memory_order_relaxed);
+			better = (la < lb || (la == lb && a.started < b.started));
+		} else if (steal_policy == Sound::StealLowestPriority) {
+			better = (a.priority < b.priority || (a.priority == b.priority && a.started < b.started));
+		} else { //StealOldest
+			better = (a.started < b.started);
+		}
+		if (better) best = i;
+	}
+	return best;
+}
+
+//helper: fill in a Play command's loop points (command->size must already be set):
+void set_loop_points(Command *command, Sound::LoopPoints const &points) {
+	command->loop_end = (points.end == 0 ? command->size : std::min(points.end, command->size));
+	command->loop_start = (points.start < command->loop_end ? points.start : 0);
+}
+
+Sound::PlayingSample start_voice(Sound::Sample const &sample, float volume, float pan, uint32_t priority, bool loop, uint64_t when, float fade_in, float pitch, Sound::LoopPoints const &points) {
+	if (sample.tone) return start_tone(*sample.tone, volume, pan, priority, loop, when, fade_in, pitch, points, sample.bus, sample.ducks);
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+	if ((device == 0 && !offline) || (sample.data.empty() && !sample.stream && !sample.cached && !sample.mapped)) {
+		//nothing would ever mix this sample:
+		return Sound::PlayingSample();
+	}
+
+	float const *data = sample.data.data();
+	uint32_t size = uint32_t(sample.data.size() / sample.channels);
+	if (sample.mapped) {
+		//(the mapping lives as long as the Sample, which -- like any Sample -- must outlive its voices)
+		data = sample.mapped->data;
+		size = sample.mapped->info.frames;
+	}
+	Sound::CacheEntry *cached = sample.cached.get();
+	bool pending = false; //(Cached sample still to be decoded; the Play waits in pending_plays)
+	if (cached) {
+		//keep the decoded audio around until the mixer is done with it:
+		pending = !pin_cached(cached);
+		if (!pending) {
+			data = cached->pcm.data();
+			size = uint32_t(cached->pcm.size() / sample.channels);
 		}
+	}
 
-		if (playing_sample.i >= playing_sample.data.size()) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
-		} else {
-			++si;
+	Sound::PlayingSample playing_sample;
+	bool stole = false;
+	playing_sample.index = acquire_voice(&stole);
+
+	VoiceOwner &owner = voice_owners[playing_sample.index];
+	owner.priority = priority;
+	owner.started = play_counter++;
+	owner.stream = sample.stream.get();
+	playing_sample.generation = owner.generation;
+
+	Command command;
+	command.type = Command::Play;
+	command.index = playing_sample.index;
+	command.generation = playing_sample.generation;
+	command.channels = sample.channels;
+	command.rate = sample.rate;
+	command.bus = sample.bus;
+	command.trigger = sample.ducks;
+	command.pitch = pitch;
+	command.cached = cached;
+	command.volume = volume;
+	command.pan = pan;
+	command.ramp = fade_in;
+	command.when = when;
+	command.loop = loop;
+	if (Sound::SampleStream *stream = sample.stream.get()) {
+		//the decode thread does the looping for streams, so it needs to know where to wrap:
+		//(the stream's length isn't known here; the decode thread moves points past the end of the file back)
+		uint64_t loop_end = (loop ? points.end : 0);
+		uint64_t loop_start = (loop && (loop_end == 0 || points.start < loop_end) ? points.start : 0);
+		bool moved = (loop_start != stream->loop_start.load(std::memory_order_relaxed) || loop_end != stream->loop_end.load(std::memory_order_relaxed));
+		stream->loop_start.store(loop_start, std::memory_order_relaxed);
+		stream->loop_end.store(loop_end, std::memory_order_relaxed);
+		//restart from the beginning (unless this is the first play with the same loop points, in which case the beginning is already decoded):
+		if (stream->played || moved) seek_stream(stream, 0);
+		stream->played = true;
+		command.stream = stream;
+		command.epoch = stream->epoch.load(std::memory_order_relaxed);
+	}
+	if (pending) {
+		if (stole) {
+			//the mixer would keep playing the voice this one took over until the Play arrives -- which won't be
+			// until decoding is done -- so stop it now (its generation is the one just before this play's):
+			Command stop;
+			stop.type = Command::Stop;
+			stop.index = playing_sample.index;
+			stop.generation = playing_sample.generation - 1;
+			stop.ramp = 1.0f / 60.0f; //(same as PlayingSample::stop's default)
+			push_command(stop);
 		}
+		//(sent by start_pending_plays once the decode thread is done)
+		owner.pending = true;
+		PendingPlay pending_play;
+		pending_play.play = command;
+		pending_play.points = points;
+		pending_plays.emplace_back(pending_play);
+		return playing_sample;
 	}
+	command.data = data;
+	command.size = size;
+	set_loop_points(&command, points);
+	if (!push_command(command)) {
+		release_unplayed_voice(playing_sample.index);
+		if (cached) cached->pins.fetch_sub(1, std::memory_order_release);
+	}
+	return playing_sample;
+}
+
+Sound::PlayingSample start_tone(Sound::Tone const &tone_, float volume, float pan, uint32_t priority, bool loop, uint64_t when, float fade_in, float pitch, Sound::LoopPoints const &points, Sound::Bus bus, bool trigger) {
+	//(tones aren't resampled; playing one faster is the same as raising its frequencies and shortening it)
+	Sound::Tone tone = tone_;
+	pitch = std::max(MIN_PITCH, std::min(MAX_PITCH, pitch));
+	tone.carrier_hz *= pitch;
+	tone.modulator_hz *= pitch;
+	tone.duration /= pitch;
 
-	/*//DEBUG: report output power:
-	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
+	uint32_t size = tone_frames(tone);
+	if ((device == 0 && !offline) || size == 0) {
+		//nothing would ever mix this tone:
+		return Sound::PlayingSample();
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
-	*/
 
+	Sound::PlayingSample playing_sample;
+	playing_sample.index = acquire_voice();
+
+	VoiceOwner &owner = voice_owners[playing_sample.index];
+	owner.priority = priority;
+	owner.started = play_counter++;
+	owner.stream = nullptr;
+	playing_sample.generation = owner.generation;
+
+	Command command;
+	command.type = Command::Play;
+	command.index = playing_sample.index;
+	command.generation = playing_sample.generation;
+	command.size = size;
+	command.synth = true;
+	command.tone = tone;
+	command.bus = bus;
+	command.trigger = trigger;
+	command.volume = volume;
+	command.pan = pan;
+	command.ramp = fade_in;
+	command.when = when;
+	command.loop = loop;
+	set_loop_points(&command, points);
+	if (!push_command(command)) {
+		release_unplayed_voice(playing_sample.index);
+	}
+	return playing_sample;
+}
+
+uint32_t tone_frames(Sound::Tone const &tone) {
+	return uint32_t(std::max(0.0f, tone.duration) * float(AUDIO_RATE));
+}
+
+//helper: generate frames [first, first + count) of a tone into 'out', using tone kernel 'fn':
+void synthesize(SynthToneFn fn, Sound::Tone const &tone, uint32_t first, uint32_t count, float *out) {
+	float const radians_per_frame = 2.0f * 3.1415926f / float(AUDIO_RATE);
+	uint32_t length = tone_frames(tone);
+	fn(out, first, count,
+		tone.carrier_hz * radians_per_frame, tone.modulator_hz * radians_per_frame, tone.index,
+		(length ? 1.0f / float(length) : 0.0f), tone.amplitude, tone.falloff);
+}
+
+//(sets *stole, if given, to whether the voice was taken over from a sound the mixer may still be playing)
+uint32_t acquire_voice(bool *stole) {
+	//collect voices the mixer has finished with:
+	Reclaimed reclaimed;
+	while (reclaimed_voices->pop(&reclaimed)) {
+		VoiceOwner &owner = voice_owners[reclaimed.index];
+		//(if the generation doesn't line up, this slot was already re-taken below)
+		if (owner.in_use && owner.generation + 1 == reclaimed.generation) {
+			owner.in_use = false;
+			free_voices.emplace_back(reclaimed.index);
+		}
+	}
+
+	uint32_t index;
+	if (stole) *stole = false;
+	if (!free_voices.empty()) {
+		index = free_voices.back();
+		free_voices.pop_back();
+		voice_owners[index].generation = voice_slots[index].generation.load(std::memory_order_acquire);
+	} else {
+		//all voices busy; take one over:
+		index = pick_victim();
+		uint32_t expected = voice_owners[index].generation;
+		if (voice_slots[index].generation.compare_exchange_strong(expected, expected + 1, std::memory_order_acq_rel)) {
+			stat_stolen_voices.fetch_add(1, std::memory_order_relaxed);
+			voice_owners[index].generation = expected + 1;
+			if (stole) *stole = true;
+		} else {
+			//the mixer released this voice a moment ago -- just use it:
+			// ('expected' now holds the released generation; the matching Reclaimed entry will be ignored)
+			voice_owners[index].generation = expected;
+		}
+	}
+
+	VoiceOwner &owner = voice_owners[index];
+	owner.in_use = true;
+	owner.stop_requested = false;
+	owner.pending = false;
+	return index;
+}
+
+void release_unplayed_voice(uint32_t index) {
+	//the Play command never reached the mixer, so the game thread still owns this generation:
+	VoiceOwner &owner = voice_owners[index];
+	voice_slots[index].generation.store(owner.generation + 1, std::memory_order_release);
+	owner.generation += 1;
+	owner.in_use = false;
+	free_voices.emplace_back(index);
+}
+
+//helper: give a finished voice back to the game thread (mixer thread):
+void release_voice(uint32_t index) {
+	Voice &voice = voices[index];
+	voice.active = false;
+	if (voice.stream && voice.stream->voice == index) voice.stream->voice = -1U;
+	if (voice.cached) {
+		voice.cached->pins.fetch_sub(1, std::memory_order_release);
+		voice.cached = nullptr;
+	}
+	voice_slots[index].level.store(0.0f, std::memory_order_relaxed);
+	uint32_t expected = voice.generation;
+	if (voice_slots[index].generation.compare_exchange_strong(expected, expected + 1, std::memory_order_acq_rel)) {
+		Reclaimed reclaimed;
+		reclaimed.index = index;
+		reclaimed.generation = expected + 1;
+		bool pushed = reclaimed_voices->push(reclaimed);
+		assert(pushed && "reclaimed_voices is sized so that it can't fill up");
+		(void)pushed;
+	}
+	//else: the game thread stole this voice; a Play command for the new generation is on its way.
+}
+
+//helper: release a voice that isn't at the current position in the mixing loop:
+void release_active_voice(uint32_t index) {
+	release_voice(index);
+	auto f = std::find(active_voices.begin(), active_voices.end(), index);
+	assert(f != active_voices.end());
+	*f = active_voices.back();
+	active_voices.pop_back();
+}
+
+//helper: fade out a voice (called from the callback):
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//helper: apply everything the game thread has asked for since the last callback:
+void drain_commands() {
+	Command command;
+	while (commands.pop(&command)) {
+		if (command.type == Command::SetGlobalVolume) {
+			Sound::volume.set(command.volume, command.ramp);
+			continue;
+		} else if (command.type == Command::StopAll) {
+			for (uint32_t index : active_voices) {
+				stop_voice(voices[index], 1.0f / 60.0f);
+			}
+			continue;
+		} else if (command.type == Command::SetBusVolume) {
+			buses[command.bus].volume.set(command.volume, command.ramp);
+			continue;
+		} else if (command.type == Command::SetBusMute) {
+			buses[command.bus].mute.set(command.volume, command.ramp);
+			continue;
+		} else if (command.type == Command::SetBusDuck) {
+			buses[command.bus].duck.set(command.volume, command.ramp);
+			continue;
+		} else if (command.type == Command::SetBusEffect) {
+			apply_bus_effect(&buses[command.bus].slots[command.index], command.effect);
+			continue;
+		} else if (command.type == Command::SetSidechain) {
+			apply_sidechain(&buses[command.bus], command.loop ? &command.sidechain : nullptr);
+			continue;
+		} else if (command.type == Command::SetLimiter) {
+			limiter.set(command.loop ? command.volume : std::numeric_limits< float >::infinity(), command.ramp, float(AUDIO_RATE));
+			continue;
+		}
+
+		assert(command.index < voice_limit);
+		Voice &voice = voices[command.index];
+		if (command.type == Command::Play) {
+			if (!voice.active) active_voices.emplace_back(command.index);
+			//(if the voice was active, it has been stolen and is simply replaced)
+			if (voice.stream && voice.stream->voice == command.index) voice.stream->voice = -1U;
+			if (voice.active && voice.cached) voice.cached->pins.fetch_sub(1, std::memory_order_release);
+			//a stream can only feed one voice, so cut off anything else reading from it:
+			if (command.stream && command.stream->voice != -1U) {
+				release_active_voice(command.stream->voice);
+			}
+			voice.data = command.data;
+			voice.size = command.size;
+			voice.channels = command.channels;
+			voice.i = 0;
+			voice.frac = 0;
+			voice.rate = command.rate;
+			voice.stream = command.stream;
+			voice.cached = command.cached;
+			voice.synth = command.synth;
+			voice.tone = command.tone;
+			voice.bus = command.bus;
+			voice.trigger = command.trigger;
+			voice.stream_epoch = command.epoch;
+			voice.block_offset = 0;
+			if (voice.stream) voice.stream->voice = command.index;
+			voice.generation = command.generation;
+			voice.start_at = command.when;
+			voice.stop_at = NoTime;
+			voice.active = true;
+			voice.loop = command.loop;
+			voice.loop_start = command.loop_start;
+			voice.loop_end = command.loop_end;
+			voice.stopping = false;
+			voice.volume = Sound::Ramp< float >(command.ramp > 0.0f ? 0.0f : command.volume);
+			voice.volume.set(command.volume, command.ramp);
+			voice.pan = Sound::Ramp< float >(command.pan);
+			voice.pitch = Sound::Ramp< float >(command.pitch);
+			voice_slots[command.index].level.store(command.volume, std::memory_order_relaxed);
+			continue;
+		}
+
+		if (!voice.active || voice.generation != command.generation) continue; //stale handle
+
+		if (command.type == Command::Stop) {
+			if (command.when == 0) {
+				stop_voice(voice, command.ramp);
+			} else {
+				//(the mixing loop starts the fade at the right frame)
+				voice.stop_at = std::min(voice.stop_at, command.when);
+				voice.stop_ramp = command.ramp;
+			}
+		} else if (command.type == Command::SetVolume) {
+			voice.volume.set(command.volume, command.ramp);
+		} else if (command.type == Command::SetPan) {
+			voice.pan.set(command.pan, command.ramp);
+		} else if (command.type == Command::SetPitch) {
+			voice.pitch.set(command.pitch, command.ramp);
+		} else if (command.type == Command::Seek) {
+			//(position is in 48kHz frames; the sample might not be)
+			uint64_t position = uint64_t(command.position) * voice.rate / AUDIO_RATE;
+			voice.frac = 0;
+			if (voice.stream) {
+				voice.stream_epoch = command.epoch;
+				voice.block_offset = 0;
+			} else if (voice.loop && position >= voice.loop_end) {
+				voice.i = voice.loop_start + uint32_t((position - voice.loop_end) % (voice.loop_end - voice.loop_start));
+			} else {
+				voice.i = uint32_t(std::min< uint64_t >(position, voice.size - 1));
+			}
+		}
+	}
+}
+
+//---- streaming ----
+
+void register_stream(Sound::SampleStream *stream) {
+	std::lock_guard< std::mutex > lock(streams_mutex);
+	streams.emplace_back(stream);
+	start_decode_thread();
+	stream_thread_wake.notify_one();
+}
+
+void start_decode_thread() {
+	//(streams_mutex must be held)
+	if (offline) return; //(Sound::render does the decoding instead)
+	if (!stream_thread.joinable()) {
+		stream_thread_quit = false;
+		stream_thread = std::thread(stream_thread_main);
+	}
+}
+
+void unregister_stream(Sound::SampleStream *stream) {
+	std::lock_guard< std::mutex > lock(streams_mutex);
+	auto f = std::find(streams.begin(), streams.end(), stream);
+	if (f != streams.end()) streams.erase(f);
+}
+
+void seek_stream(Sound::SampleStream *stream, uint64_t frame) {
+	stream->seek_to.store(frame, std::memory_order_relaxed);
+	stream->epoch.fetch_add(1, std::memory_order_release);
+	stream_thread_wake.notify_one();
+}
+
+//helper: decode blocks until the stream's ring is full (decode thread):
+void fill_stream(Sound::SampleStream &stream) {
+	uint32_t epoch = stream.epoch.load(std::memory_order_acquire);
+	if (epoch != stream.decoded_epoch) {
+		stream.decode_loop_start = stream.loop_start.load(std::memory_order_relaxed);
+		stream.decode_loop_end = stream.loop_end.load(std::memory_order_relaxed);
+		uint64_t frame = stream.seek_to.load(std::memory_order_relaxed);
+		if (stream.decode_loop_end != 0 && frame >= stream.decode_loop_end) {
+			//(seeking past the loop end lands where looping would have)
+			frame = stream.decode_loop_start + (frame - stream.decode_loop_end) % (stream.decode_loop_end - stream.decode_loop_start);
+		}
+		stream.opus.seek(frame);
+		stream.decoded_frame = frame;
+		stream.decoded_epoch = epoch;
+	}
+	while (StreamBlock *block = stream.blocks.write_slot()) {
+		block->frames = 0;
+		block->epoch = stream.decoded_epoch;
+		block->last = false;
+		while (block->frames < STREAM_BLOCK_FRAMES) {
+			uint32_t want = STREAM_BLOCK_FRAMES - block->frames;
+			if (stream.decode_loop_end != 0) want = uint32_t(std::min< uint64_t >(want, stream.decode_loop_end - stream.decoded_frame));
+			uint32_t got = (want ? stream.opus.read(block->data + block->frames * stream.opus.channels, want) : 0);
+			if (got == 0) {
+				//end of file (or loop): mark it (so the mixer can stop there) but keep going from the loop start (so it can also loop):
+				block->last = true;
+				if (stream.decode_loop_start >= stream.decoded_frame) stream.decode_loop_start = 0; //(loop start was past the end of the file)
+				stream.opus.seek(stream.decode_loop_start);
+				stream.decoded_frame = stream.decode_loop_start;
+				break;
+			}
+			block->frames += got;
+			stream.decoded_frame += got;
+		}
+		stream.blocks.commit_write();
+		//seeked while decoding? start over:
+		if (stream.epoch.load(std::memory_order_acquire) != stream.decoded_epoch) break;
+	}
+}
+
+//helper: top up every stream (streams_mutex must be held):
+void fill_all_streams() {
+	for (auto stream : streams) {
+		if (stream->failed) continue;
+		try {
+			fill_stream(*stream);
+		} catch (std::exception &e) {
+			std::cerr << "Error streaming audio: " << e.what() << std::endl;
+			stream->failed = true;
+		}
+	}
+}
+
+//helper: all of the decode thread's work, done on the calling thread (for offline rendering):
+void fill_streams() {
+	std::lock_guard< std::mutex > lock(streams_mutex);
+	fill_all_streams();
+	while (prefetch_step()) { }
+}
+
+void stream_thread_main() {
+	std::unique_lock< std::mutex > lock(streams_mutex);
+	while (!stream_thread_quit) {
+		fill_all_streams();
+		//prefetching is done a chunk at a time in between keeping streams topped up:
+		if (prefetch_step()) continue;
+		//the mixer never signals this thread (it must not block), so check back well before the buffered audio runs out:
+		stream_thread_wake.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	abandon_prefetch();
+}
+
+//helper: copy up to 'count' frames (of voice.channels values each) from a voice's stream into 'out' (mixer thread):
+// returns the number of frames copied; sets *ended if the stream ran out and the voice isn't looping
+// (with a null 'out', the frames are just skipped over)
+uint32_t read_stream(Voice &voice, float *out, uint32_t count, bool *ended) {
+	Sound::SampleStream &stream = *voice.stream;
+	uint32_t copied = 0;
+	while (copied < count) {
+		StreamBlock *block = stream.blocks.read_slot();
+		if (!block) break; //not decoded yet
+		int32_t age = int32_t(voice.stream_epoch - block->epoch);
+		if (age > 0) { //block from before a seek; skip
+			stream.blocks.commit_read();
+			voice.block_offset = 0;
+			continue;
+		} else if (age < 0) { //block from after a seek this voice hasn't heard about yet; wait
+			break;
+		}
+		uint32_t n = std::min(count - copied, block->frames - voice.block_offset);
+		if (out) std::memcpy(out + copied * voice.channels, block->data + voice.block_offset * voice.channels, n * voice.channels * sizeof(float));
+		copied += n;
+		voice.block_offset += n;
+		if (voice.block_offset == block->frames) {
+			bool last = block->last;
+			stream.blocks.commit_read();
+			voice.block_offset = 0;
+			if (last && !voice.loop) {
+				*ended = true;
+				break;
+			}
+		}
+	}
+	return copied;
+}
+
+//---- cache ----
+
+Sound::CacheEntry::CacheEntry(std::string const &filename_) : filename(filename_) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	opus_data.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+	opus = opus_data.data();
+	opus_size = opus_data.size();
+	probe();
+}
+
+Sound::CacheEntry::CacheEntry(std::string const &name, unsigned char const *data, size_t size) : filename(name), opus(data), opus_size(size) {
+	probe();
+}
+
+void Sound::CacheEntry::probe() {
+	//check that the file can be decoded (and find out its shape) now, rather than on first play:
+	OpusStream probe(filename, opus, opus_size);
+	channels = probe.channels;
+	length = probe.length();
+	if (length == 0) {
+		throw std::runtime_error("Sample '" + filename + "' is empty.");
+	}
+}
+
+void register_cached(Sound::CacheEntry *entry) {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	cache_entries.emplace_back(entry);
+}
+
+void unregister_cached(Sound::CacheEntry *entry) {
+	std::unique_lock< std::mutex > lock(cache_mutex);
+	//can't pull the entry out from under the decode thread:
+	cache_prefetched.wait(lock, [entry](){ return entry->state != Sound::CacheEntry::Prefetching; });
+	if (entry->state == Sound::CacheEntry::Resident) cache_resident -= entry->pcm.size() * sizeof(float);
+	auto f = std::find(cache_entries.begin(), cache_entries.end(), entry);
+	if (f != cache_entries.end()) cache_entries.erase(f);
+	f = std::find(cache_prefetch.begin(), cache_prefetch.end(), entry);
+	if (f != cache_prefetch.end()) cache_prefetch.erase(f);
+}
+
+//helper: drop least-recently-used decoded audio until the pool fits the budget (cache_mutex must be held):
+// entries that are pinned (or 'keep') are skipped
+void evict_cached(Sound::CacheEntry *keep) {
+	while (cache_resident > cache_budget) {
+		Sound::CacheEntry *oldest = nullptr;
+		for (auto entry : cache_entries) {
+			if (entry == keep || entry->state != Sound::CacheEntry::Resident) continue;
+			if (entry->pins.load(std::memory_order_acquire) != 0) continue;
+			if (!oldest || entry->last_used < oldest->last_used) oldest = entry;
+		}
+		if (!oldest) break; //everything is in use
+		cache_resident -= oldest->pcm.size() * sizeof(float);
+		std::vector< float >().swap(oldest->pcm); //(actually release the memory)
+		oldest->state = Sound::CacheEntry::Compressed;
+		stat_cache_evictions += 1;
+	}
+}
+
+//helper: append up to 'frames' frames from 'decoder' to 'pcm'; returns false once the end of the file is reached:
+bool decode_frames(OpusStream &decoder, std::vector< float > &pcm, uint32_t frames) {
+	while (frames > 0) {
+		size_t at = pcm.size();
+		pcm.resize(at + size_t(frames) * decoder.channels);
+		uint32_t got = decoder.read(pcm.data() + at, frames);
+		pcm.resize(at + size_t(got) * decoder.channels);
+		if (got == 0) return false;
+		frames -= got;
+	}
+	return true;
+}
+
+//helper: pin a cached sample's decoded audio, so it stays around until the mixer is done with it (game thread):
+// returns false if the sample isn't decoded yet, in which case it is pinned anyway (so it can't be evicted once it is)
+// and moved to the front of the decode thread's prefetch queue -- see start_pending_plays
+bool pin_cached(Sound::CacheEntry *entry) {
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		entry->last_used = ++cache_clock;
+		entry->pins.fetch_add(1, std::memory_order_relaxed);
+		if (entry->state == Sound::CacheEntry::Resident) {
+			stat_cache_hits += 1;
+			return true;
+		}
+		stat_cache_misses += 1;
+		if (entry->state == Sound::CacheEntry::Prefetching) return false; //(already as soon as it can be)
+
+		//jump the queue (but don't disturb the front entry if the decode thread is partway through it):
+		if (entry->state == Sound::CacheEntry::Queued) {
+			cache_prefetch.erase(std::find(cache_prefetch.begin(), cache_prefetch.end(), entry));
+		}
+		entry->state = Sound::CacheEntry::Queued;
+		auto at = cache_prefetch.begin();
+		if (at != cache_prefetch.end() && (*at)->state == Sound::CacheEntry::Prefetching) ++at;
+		cache_prefetch.insert(at, entry);
+	}
+	//wake (or start) the decode thread:
+	std::lock_guard< std::mutex > lock(streams_mutex);
+	start_decode_thread();
+	stream_thread_wake.notify_one();
+	return false;
+}
+
+//helper: forget pending_plays[at], giving back its voice (unless that was stolen) and its pin (game thread):
+void drop_pending_play(uint32_t at) {
+	PendingPlay &pending = pending_plays[at];
+	VoiceOwner &owner = voice_owners[pending.play.index];
+	if (owner.generation == pending.play.generation) {
+		owner.pending = false;
+		release_unplayed_voice(pending.play.index);
+	}
+	pending.play.cached->pins.fetch_sub(1, std::memory_order_release);
+	pending_plays.erase(pending_plays.begin() + at);
+}
+
+//helper: send the Play commands of pending plays whose samples have finished decoding (game thread):
+void start_pending_plays() {
+	for (uint32_t i = 0; i < pending_plays.size(); /* (i only advances past plays left waiting) */) {
+		PendingPlay &pending = pending_plays[i];
+		Command &play = pending.play;
+		Sound::CacheEntry *cached = play.cached;
+		if (voice_owners[play.index].generation != play.generation) {
+			//voice was stolen while waiting:
+			drop_pending_play(i);
+			continue;
+		}
+
+		Sound::CacheEntry::State state;
+		{
+			std::lock_guard< std::mutex > lock(cache_mutex);
+			state = cached->state;
+		}
+		if (state == Sound::CacheEntry::Queued || state == Sound::CacheEntry::Prefetching) {
+			++i; //still decoding
+			continue;
+		}
+		if (state != Sound::CacheEntry::Resident) {
+			//decoding failed (and was reported by the decode thread) or was abandoned at shutdown:
+			drop_pending_play(i);
+			continue;
+		}
+
+		play.data = cached->pcm.data();
+		play.size = uint32_t(cached->pcm.size() / play.channels);
+		set_loop_points(&play, pending.points);
+		voice_owners[play.index].pending = false;
+		if (push_command(play)) {
+			for (auto const &command : pending.after) {
+				push_command(command);
+			}
+		} else {
+			release_unplayed_voice(play.index);
+			cached->pins.fetch_sub(1, std::memory_order_release);
+		}
+		pending_plays.erase(pending_plays.begin() + i);
+	}
+}
+
+//helper: send a command to a voice -- or, if the voice's Play is still in pending_plays, hold it to send right after (game thread):
+void push_voice_command(Command const &command) {
+	if (voice_owners[command.index].pending) {
+		for (auto &pending : pending_plays) {
+			if (pending.play.index == command.index && pending.play.generation == command.generation) {
+				pending.after.emplace_back(command);
+				return;
+			}
+		}
+	}
+	push_command(command);
+}
+
+//helper: decode one chunk of the oldest prefetch request (decode thread);
+// returns true if there is more prefetching to do
+bool prefetch_step() {
+	Sound::CacheEntry *entry;
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		if (cache_prefetch.empty()) return false;
+		entry = cache_prefetch.front();
+		if (entry->state == Sound::CacheEntry::Queued) {
+			entry->state = Sound::CacheEntry::Prefetching;
+		}
+		assert(entry->state == Sound::CacheEntry::Prefetching);
+	}
+
+	bool more = false;
+	bool ok = true;
+	try {
+		if (!entry->decoder) {
+			entry->decoder.reset(new OpusStream(entry->filename, entry->opus, entry->opus_size));
+			entry->pcm.reserve(size_t(entry->length) * entry->channels);
+		}
+		more = decode_frames(*entry->decoder, entry->pcm, PREFETCH_CHUNK_FRAMES);
+	} catch (std::exception &e) {
+		std::cerr << "Error prefetching cached audio: " << e.what() << std::endl;
+		ok = false;
+	}
+	if (ok && more) return true;
+
+	//finished (or failed):
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	entry->decoder.reset();
+	cache_prefetch.erase(cache_prefetch.begin());
+	if (ok && !entry->pcm.empty()) {
+		entry->state = Sound::CacheEntry::Resident;
+		cache_resident += entry->pcm.size() * sizeof(float);
+		evict_cached(entry);
+	} else {
+		std::vector< float >().swap(entry->pcm);
+		entry->state = Sound::CacheEntry::Compressed;
+	}
+	cache_prefetched.notify_all();
+	return !cache_prefetch.empty();
+}
+
+//helper: the decode thread is exiting; put back any half-done prefetch so nothing waits on it forever:
+void abandon_prefetch() {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	for (auto entry : cache_prefetch) {
+		entry->decoder.reset();
+		std::vector< float >().swap(entry->pcm);
+		entry->state = Sound::CacheEntry::Compressed;
+	}
+	cache_prefetch.clear();
+	cache_prefetched.notify_all();
+}
+
+//helper: equal-power panning (left^2 + right^2 = 1.0), looked up in pan_table:
+inline void compute_pan_weights(float pan, float *left, float *right) {
+	//clamp pan to -1 to 1 range:
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+
+	float x = (pan + 1.0f) * (0.5f * float(PAN_TABLE_SIZE));
+	uint32_t i = uint32_t(x);
+	float t = x - float(i);
+	*left = pan_table.left[i] + t * (pan_table.left[i+1] - pan_table.left[i]);
+
+	//right gain is the left gain of the mirrored pan:
+	float y = float(PAN_TABLE_SIZE) - x;
+	uint32_t j = uint32_t(y);
+	float u = y - float(j);
+	*right = pan_table.left[j] + u * (pan_table.left[j+1] - pan_table.left[j]);
+}
+
+//helper: balance for stereo samples -- the centered position leaves both channels alone,
+// moving toward one side fades out the other channel:
+inline void compute_balance_weights(float pan, float *left, float *right) {
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+	*left = std::min(1.0f, 1.0f - pan);
+	*right = std::min(1.0f, 1.0f + pan);
+}
+
+//helper: ramp update for single values, moving 'elapsed' seconds along:
+// (the same total change happens whether time passes in one big step or several small ones,
+//  so ramps take as long as they should no matter what the block size is)
+// (written as selects rather than branches, since it runs for every voice every block)
+void step_value_ramp(Sound::Ramp< float > &ramp, float elapsed) {
+	bool done = !(ramp.ramp > elapsed);
+	float t = (done ? 1.0f : elapsed / ramp.ramp);
+	float next = ramp.value + t * (ramp.target - ramp.value);
+	ramp.value = (done ? ramp.target : next);
+	ramp.ramp = std::max(0.0f, ramp.ramp - elapsed);
+}
+
+//helper: work out the gains of every voice that plays for the whole of this block, moving their ramps along:
+// (voices that start or stop partway through are left for mix_voice, which handles each part separately)
+void compute_block_gains(uint64_t block_start, uint64_t block_end, uint32_t frames) {
+	float elapsed = float(frames) / float(AUDIO_RATE);
+	uint32_t count = uint32_t(active_voices.size());
+
+	//gather pan and volume at the start and end of the block:
+	for (uint32_t vi = 0; vi < count; ++vi) {
+		uint32_t index = active_voices[vi];
+		Voice &voice = voices[index];
+		bool whole = (voice.start_at <= block_start && voice.stop_at >= block_end);
+		block_gains.whole[vi] = whole;
+		if (!whole) continue;
+		block_gains.stereo[vi] = (voice.channels == 2);
+		block_gains.pan[0][vi] = voice.pan.value;
+		block_gains.volume[0][vi] = voice.volume.value;
+		step_value_ramp(voice.pan, elapsed);
+		step_value_ramp(voice.volume, elapsed);
+		voice_slots[index].level.store(voice.volume.value, std::memory_order_relaxed);
+		block_gains.pan[1][vi] = voice.pan.value;
+		block_gains.volume[1][vi] = voice.volume.value;
+	}
+
+	//...then turn them into per-channel gains and steps:
+	// (entries for voices that aren't 'whole' hold stale values; they are computed anyway and ignored)
+	float const step_scale = 1.0f / float(frames);
+	for (uint32_t vi = 0; vi < count; ++vi) {
+		float pan_l[2], pan_r[2], balance_l[2], balance_r[2];
+		float start_l, start_r, end_l, end_r;
+		bool stereo = block_gains.stereo[vi];
+		for (uint32_t e = 0; e < 2; ++e) {
+			compute_pan_weights(block_gains.pan[e][vi], &pan_l[e], &pan_r[e]);
+			compute_balance_weights(block_gains.pan[e][vi], &balance_l[e], &balance_r[e]);
+		}
+		start_l = (stereo ? balance_l[0] : pan_l[0]) * block_gains.volume[0][vi];
+		start_r = (stereo ? balance_r[0] : pan_r[0]) * block_gains.volume[0][vi];
+		end_l = (stereo ? balance_l[1] : pan_l[1]) * block_gains.volume[1][vi];
+		end_r = (stereo ? balance_r[1] : pan_r[1]) * block_gains.volume[1][vi];
+		block_gains.start_l[vi] = start_l;
+		block_gains.start_r[vi] = start_r;
+		block_gains.step_l[vi] = (end_l - start_l) * step_scale;
+		block_gains.step_r[vi] = (end_r - start_r) * step_scale;
+		//(gains ramp linearly, so the largest is at one end or the other)
+		block_gains.peak[vi] = std::max(std::max(std::abs(start_l), std::abs(start_r)), std::max(std::abs(end_l), std::abs(end_r)));
+	}
+}
+
+//helper: mix frames [begin,end) of the current block from one voice into 'out' (interleaved stereo),
+// moving its ramps along by the same amount of time; returns true if the voice ran out of sample.
+bool mix_voice(uint32_t index, float *out, uint32_t begin, uint32_t end) {
+	Voice &voice = voices[index];
+	uint32_t frames = end - begin;
+	if (frames == 0) return false;
+
+	//mono samples are panned; stereo samples have their balance adjusted:
+	bool stereo = (voice.channels == 2);
+	auto weights = (stereo ? compute_balance_weights : compute_pan_weights);
+
+	//Figure out sample panning/volume at start...
+	float start_l, start_r;
+	weights(voice.pan.value, &start_l, &start_r);
+	start_l *= voice.volume.value;
+	start_r *= voice.volume.value;
+
+	float elapsed = float(frames) / float(AUDIO_RATE);
+	step_value_ramp(voice.pan, elapsed);
+	step_value_ramp(voice.volume, elapsed);
+	voice_slots[index].level.store(voice.volume.value, std::memory_order_relaxed);
+
+	//..and end of the mix period:
+	float end_l, end_r;
+	weights(voice.pan.value, &end_l, &end_r);
+	end_l *= voice.volume.value;
+	end_r *= voice.volume.value;
+
+	//figure out a step to add at each sample so that pan will move smoothly from start to end:
+	float step_l = (end_l - start_l) / float(frames);
+	float step_r = (end_r - start_r) / float(frames);
+
+	return mix_voice_frames(voice, out + 2 * begin, frames, start_l, start_r, step_l, step_r);
+}
+
+//helper: source frames a voice moves through per output frame (32.32 fixed point), or 0 if it isn't being resampled:
+uint64_t voice_resample_step(Voice const &voice) {
+	if (!voice.data || (voice.rate == AUDIO_RATE && voice.pitch.value == 1.0f && voice.pitch.target == 1.0f && voice.frac == 0)) return 0;
+	float ratio = std::max(MIN_PITCH, std::min(MAX_PITCH, voice.pitch.value * float(voice.rate) / float(AUDIO_RATE)));
+	return uint64_t(double(ratio) * 4294967296.0);
+}
+
+//helper: mix 'frames' frames of a voice into 'out' (interleaved stereo) with the given gains, as in mix_kernels.hpp;
+// returns true if the voice ran out of sample.
+bool mix_voice_frames(Voice &voice, float *out, uint32_t frames, float start_l, float start_r, float step_l, float step_r) {
+	bool stereo = (voice.channels == 2);
+
+	//samples that aren't at 48kHz (or are being played at another pitch) are resampled as they are read:
+	// (pitch changes take effect a block -- or part of a block -- at a time)
+	uint64_t resample_step = voice_resample_step(voice);
+	step_value_ramp(voice.pitch, float(frames) / float(AUDIO_RATE));
+
+	//mix in pieces, since looping samples may wrap around and streams arrive in blocks:
+	uint32_t done = 0;
+	bool finished = false;
+	while (done < frames && !finished) {
+		float const *src;
+		uint32_t count;
+		if (voice.stream) {
+			src = stream_scratch.data();
+			count = read_stream(voice, stream_scratch.data(), frames - done, &finished);
+			if (count == 0 && !finished) {
+				//decode thread has fallen behind; the rest of the block is silent:
+				stat_stream_underruns.fetch_add(1, std::memory_order_relaxed);
+				break;
+			}
+		} else if (resample_step) {
+			src = stream_scratch.data();
+			count = resample_voice(voice, resample_step, stream_scratch.data(), frames - done, &finished);
+		} else {
+			uint32_t end = (voice.loop ? voice.loop_end : voice.size);
+			assert(voice.i < end);
+			count = std::min(frames - done, end - voice.i);
+			if (voice.synth) {
+				synthesize(synth_tone, voice.tone, voice.i, count, stream_scratch.data());
+				src = stream_scratch.data();
+			} else {
+				src = voice.data + voice.i * voice.channels;
+			}
+			voice.i += count;
+			if (voice.i == end) {
+				if (voice.loop) voice.i = voice.loop_start;
+				else finished = true; //(if the sample ends early, the rest of the block is just silent)
+			}
+		}
+		(stereo ? mix_stereo : mix_mono)(src, out + 2 * done, count,
+			start_l + float(done) * step_l, start_r + float(done) * step_r,
+			step_l, step_r);
+		done += count;
+	}
+	return finished;
+}
+
+//helper: resample up to 'frames' frames of a voice into 'out' (same number of channels as the voice), moving it 'step'
+// (32.32 fixed point) source frames per output frame; stops early at the end of the sample (or loop) and returns
+// the number of frames written. Sets '*finished' if a non-looping voice ran out of sample.
+uint32_t resample_voice(Voice &voice, uint64_t step, float *out, uint32_t frames, bool *finished) {
+	uint32_t const end_frame = (voice.loop ? voice.loop_end : voice.size);
+	uint64_t const end = uint64_t(end_frame) << 32;
+	uint64_t position = (uint64_t(voice.i) << 32) | voice.frac;
+	assert(position < end);
+
+	//output frames before the position passes the end of the sample (or loop):
+	uint32_t count = uint32_t(std::min< uint64_t >(frames, (end - position + step - 1) / step));
+
+	ResampleFn resample = (voice.channels == 2 ? resample_stereo : resample_mono);
+	float const *table = get_resample_table(step);
+
+	//the filter reads source frames [first, last]:
+	int64_t first = int64_t(voice.i) - int64_t(RESAMPLE_BEFORE);
+	int64_t last = int64_t((position + (count - 1) * step) >> 32) + int64_t(RESAMPLE_AFTER);
+	if (first >= 0 && last < int64_t(end_frame)) {
+		resample(voice.data, out, count, position, step, table);
+	} else {
+		//near the ends of the sample (or the loop end), the filter reaches past them: copy what it needs
+		// (wrapping back to the loop start for looping samples, silence otherwise) and filter that instead, a piece at a time:
+		uint32_t const loop_length = voice.loop_end - voice.loop_start;
+		for (uint32_t done = 0; done < count; /* later */) {
+			uint32_t piece = std::min(count - done, RESAMPLE_EDGE_FRAMES);
+			uint64_t at = position + done * step;
+			int64_t from = int64_t(at >> 32) - int64_t(RESAMPLE_BEFORE);
+			int64_t to = int64_t((at + (piece - 1) * step) >> 32) + int64_t(RESAMPLE_AFTER);
+			assert(uint64_t(to - from + 1) * voice.channels <= resample_edge.size());
+			for (int64_t f = from; f <= to; ++f) {
+				int64_t source = f;
+				if (voice.loop) {
+					//(before the start, the sample is heard as if it had already looped -- exact for ordinary loops, and only
+					// a few frames of filter pre-roll when the loop starts later)
+					if (f >= int64_t(voice.loop_end)) source = voice.loop_start + (f - voice.loop_end) % loop_length;
+					else if (f < 0) source = voice.loop_end - 1 - (-1 - f) % loop_length;
+				}
+				bool inside = (source >= 0 && source < int64_t(voice.size));
+				for (uint32_t c = 0; c < voice.channels; ++c) {
+					resample_edge[(f - from) * voice.channels + c] = (inside ? voice.data[source * voice.channels + c] : 0.0f);
+				}
+			}
+			//(position relative to the copy: RESAMPLE_BEFORE frames in, same fraction)
+			resample(resample_edge.data(), out + done * voice.channels, piece, (uint64_t(RESAMPLE_BEFORE) << 32) | uint32_t(at), step, table);
+			done += piece;
+		}
+	}
+
+	position += count * step;
+	if (position >= end) {
+		//(loops shorter than a step may wrap more than once)
+		if (voice.loop) position = (uint64_t(voice.loop_start) << 32) + (position - end) % (uint64_t(voice.loop_end - voice.loop_start) << 32);
+		else *finished = true;
+	}
+	voice.i = uint32_t(position >> 32);
+	voice.frac = uint32_t(position);
+	return count;
+}
+
+//helper: move a voice along by 'frames' frames without reading or mixing any of it (for voices too quiet to hear);
+// ends up exactly where mix_voice_frames would have, so the voice carries on seamlessly once it can be heard again.
+// returns true if the voice ran out of sample.
+bool skip_voice_frames(Voice &voice, uint32_t frames) {
+	uint64_t resample_step = voice_resample_step(voice);
+	step_value_ramp(voice.pitch, float(frames) / float(AUDIO_RATE));
+
+	bool finished = false;
+	if (voice.stream) {
+		//(the decoded blocks still have to be taken out of the ring, or the decode thread would stall -- they just aren't copied)
+		uint32_t count = read_stream(voice, nullptr, frames, &finished);
+		if (count < frames && !finished) stat_stream_underruns.fetch_add(1, std::memory_order_relaxed);
+	} else if (resample_step) {
+		uint64_t const end = uint64_t(voice.loop ? voice.loop_end : voice.size) << 32;
+		uint64_t position = ((uint64_t(voice.i) << 32) | voice.frac) + frames * resample_step;
+		if (position >= end) {
+			if (voice.loop) position = (uint64_t(voice.loop_start) << 32) + (position - end) % (uint64_t(voice.loop_end - voice.loop_start) << 32);
+			else finished = true;
+		}
+		voice.i = uint32_t(position >> 32);
+		voice.frac = uint32_t(position);
+	} else {
+		uint32_t const end = (voice.loop ? voice.loop_end : voice.size);
+		uint64_t at = uint64_t(voice.i) + frames;
+		if (at >= end) {
+			if (voice.loop) at = voice.loop_start + (at - end) % (voice.loop_end - voice.loop_start);
+			else finished = true;
+		}
+		voice.i = uint32_t(at);
+	}
+	return finished;
+}
+
+//helper: put an effect into a bus's effect slot (mixer thread):
+void apply_bus_effect(BusSlot *slot, Sound::Effect const &effect) {
+	//a new kind of effect starts from silence; new settings for the same kind carry on from where it is:
+	if (effect.type != slot->type) {
+		slot->low_pass.reset();
+		slot->reverb.reset();
+		slot->type = effect.type;
+	}
+	if (effect.type == Sound::Effect::LowPass) {
+		slot->low_pass.set(effect.cutoff_hz, float(AUDIO_RATE));
+	} else if (effect.type == Sound::Effect::Reverb) {
+		slot->reverb.set(effect.room_size, effect.damping, effect.wet);
+	}
+}
+
+//helper: set up (or, if 'sidechain' is null, remove) a bus's sidechain (mixer thread):
+void apply_sidechain(BusState *bus, Sound::Sidechain const *sidechain) {
+	if (!sidechain) {
+		bus->sidechained = false;
+		bus->envelope = 0.0f;
+		return;
+	}
+	//(one-pole smoothing: after 'time' seconds the envelope has moved about 63% of the way)
+	auto coef = [](float time) {
+		return (time > 0.0f ? 1.0f - std::exp(-1.0f / (time * float(AUDIO_RATE))) : 1.0f);
+	};
+	bus->sidechained = true;
+	bus->sidechain_depth = 1.0f - std::max(0.0f, std::min(sidechain->level, 1.0f));
+	bus->sidechain_threshold = std::max(1e-6f, sidechain->threshold);
+	bus->attack_coef = coef(sidechain->attack);
+	bus->release_coef = coef(sidechain->release);
+}
+
+//helper: measure the loudness of this block's trigger voices (in each bus's 'key'), fill in the per-frame
+// 'sidechain_gain' of every sidechained bus, and move the triggers over into their buses' output:
+void run_sidechains(uint32_t frames) {
+	bool keyed = false;
+	for (auto const &bus : buses) keyed = keyed || bus.keyed;
+
+	if (keyed) {
+		for (uint32_t k = 0; k < frames; ++k) {
+			float l = 0.0f, r = 0.0f;
+			for (auto const &bus : buses) {
+				l += bus.key[2*k+0];
+				r += bus.key[2*k+1];
+			}
+			key_level[k] = std::max(std::abs(l), std::abs(r));
+		}
+		for (auto &bus : buses) {
+			if (!bus.keyed) continue;
+			for (uint32_t i = 0; i < 2 * frames; ++i) bus.out[i] += bus.key[i];
+			bus.used = true;
+		}
+	}
+
+	for (auto &bus : buses) {
+		bus.ducking = false;
+		if (!bus.sidechained) continue;
+		if (!keyed && bus.envelope < 1e-6f) {
+			bus.envelope = 0.0f;
+			continue; //(nothing playing, nothing left to release)
+		}
+		//peak follower -- rises at the attack rate, falls at the release rate:
+		float envelope = bus.envelope;
+		float const inv_threshold = 1.0f / bus.sidechain_threshold;
+		for (uint32_t k = 0; k < frames; ++k) {
+			float x = (keyed ? key_level[k] : 0.0f);
+			envelope += (x - envelope) * (x > envelope ? bus.attack_coef : bus.release_coef);
+			bus.sidechain_gain[k] = 1.0f - bus.sidechain_depth * std::min(1.0f, envelope * inv_threshold);
+		}
+		bus.envelope = envelope;
+		bus.ducking = true;
+	}
+}
+
+//helper: run each bus's effects, then add it to 'out' (interleaved stereo), with its gain (and the global
+// volume, which is block_volume[0] at the start of the block and block_volume[1] at the end) ramping linearly
+// -- and, if its sidechain is ducking it, its per-frame sidechain gain, too:
+void mix_buses(float *out, uint32_t frames, float const block_volume[2]) {
+	float elapsed = float(frames) / float(AUDIO_RATE);
+	for (auto &bus : buses) {
+		float start = bus.volume.value * bus.mute.value * bus.duck.value * block_volume[0];
+		step_value_ramp(bus.volume, elapsed);
+		step_value_ramp(bus.mute, elapsed);
+		step_value_ramp(bus.duck, elapsed);
+		float end = bus.volume.value * bus.mute.value * bus.duck.value * block_volume[1];
+
+		bool effects = false;
+		for (auto const &slot : bus.slots) effects = effects || (slot.type != Sound::Effect::None);
+		//(effects run even on silent blocks, so reverb tails ring out)
+		if (!bus.used && !effects) continue;
+
+		for (auto &slot : bus.slots) {
+			if (slot.type == Sound::Effect::LowPass) slot.low_pass.process(bus.out, frames);
+			else if (slot.type == Sound::Effect::Reverb) slot.reverb.process(bus.out, frames);
+		}
+
+		if (start == 0.0f && end == 0.0f) continue; //(muted)
+		float step = (end - start) / float(frames);
+		if (bus.ducking) {
+			for (uint32_t k = 0; k < frames; ++k) {
+				float gain = (start + float(k) * step) * bus.sidechain_gain[k];
+				out[2*k+0] += gain * bus.out[2*k+0];
+				out[2*k+1] += gain * bus.out[2*k+1];
+			}
+		} else {
+			for (uint32_t k = 0; k < frames; ++k) {
+				float gain = start + float(k) * step;
+				out[2*k+0] += gain * bus.out[2*k+0];
+				out[2*k+1] += gain * bus.out[2*k+1];
+			}
+		}
+	}
+}
+
+//helper for mix_audio: mix the next 'frames' (at most MAX_MIX_SAMPLES) frames of audio into 'buffer' (interleaved stereo):
+// (the buses and sidechain/limiter scratch in mix_arena only have room for MAX_MIX_SAMPLES frames, so bigger device blocks are mixed in pieces)
+struct BlockTotals {
+	uint32_t virtual_voices = 0; //(most in any one piece)
+	uint32_t clipped = 0;
+	uint32_t limited = 0;
+	float min_gain = 1.0f;
+};
+void mix_block(float *buffer, uint32_t frames, BlockTotals *totals) {
+	assert(frames <= MAX_MIX_SAMPLES);
+
+	//mixer clock values covered by this block are [block_start, block_start + frames):
+	uint64_t block_start = mix_clock_frames.load(std::memory_order_relaxed);
+	uint64_t block_end = block_start + frames;
+
+	//zero the buses:
+	for (auto &bus : buses) {
+		std::memset(bus.out, 0, 2 * frames * sizeof(float));
+		std::memset(bus.key, 0, 2 * frames * sizeof(float));
+		bus.used = false;
+		bus.keyed = false;
+	}
+
+	compute_block_gains(block_start, block_end, frames);
+
+	//the most each bus (along with the global volume) can turn its voices up during this block, for spotting inaudible ones:
+	// (ramps are linear, so their largest values are at one end or the other)
+	float bus_peak[Sound::BusCount];
+	for (uint32_t b = 0; b < Sound::BusCount; ++b) {
+		BusState const &bus = buses[b];
+		bus_peak[b] = std::max(Sound::volume.value, Sound::volume.target)
+			* std::max(bus.volume.value, bus.volume.target)
+			* std::max(bus.mute.value, bus.mute.target)
+			* std::max(bus.duck.value, bus.duck.target);
+	}
+	uint32_t virtual_voices = 0;
+
+	//add audio from each playing voice into its bus:
+	for (uint32_t vi = 0; vi < active_voices.size(); /* later */) {
+		uint32_t index = active_voices[vi];
+		Voice &voice = voices[index];
+		BusState &bus = buses[voice.bus];
+		float *out = (voice.trigger ? bus.key : bus.out);
+
+		bool finished = false;
+		//(trigger voices are measured before their bus's gain is applied, so only their own gain counts)
+		if (block_gains.whole[vi] && block_gains.peak[vi] * (voice.trigger ? 1.0f : bus_peak[voice.bus]) < INAUDIBLE_GAIN) {
+			//too quiet to hear -- move it along without mixing it, and if it is fading out after stop(), it's done:
+			finished = voice.stopping || skip_voice_frames(voice, frames);
+			virtual_voices += 1;
+		} else if (block_gains.whole[vi]) {
+			(voice.trigger ? bus.keyed : bus.used) = true;
+			//the usual case -- voice plays for the whole block, and its gains were already worked out:
+			finished = mix_voice_frames(voice, out, frames,
+				block_gains.start_l[vi], block_gains.start_r[vi], block_gains.step_l[vi], block_gains.step_r[vi]);
+		} else {
+			(voice.trigger ? bus.keyed : bus.used) = true;
+			//voices scheduled with play_at start partway into a block (or not at all, yet):
+			if (voice.start_at >= block_end) {
+				if (!voice.stopping) {
+					++vi;
+					continue;
+				}
+				finished = true; //(stopped before it ever started)
+			}
+			uint32_t begin = uint32_t(std::min(std::max(voice.start_at, block_start), block_end) - block_start);
+
+			if (!finished && voice.stop_at < block_end) {
+				//scheduled stop: mix up to the stop frame, then start the fade (or just end the voice):
+				uint32_t at = uint32_t(std::max(voice.stop_at, block_start + begin) - block_start);
+				finished = mix_voice(index, out, begin, at);
+				voice.stop_at = NoTime;
+				if (voice.stop_ramp <= 0.0f) finished = true;
+				else stop_voice(voice, voice.stop_ramp);
+				begin = at;
+			}
+			if (!finished) finished = mix_voice(index, out, begin, frames);
+		}
+
+		//a stopped voice is done once it has faded out (otherwise looping voices would never end):
+		if (voice.stopping && voice.volume.value == 0.0f) finished = true;
+
+		if (finished) { //sample has finished
+			release_voice(index);
+			//erase from list (order doesn't matter, so swap with last):
+			active_voices[vi] = active_voices.back();
+			block_gains.move(uint32_t(active_voices.size()) - 1, vi);
+			active_voices.pop_back();
+		} else {
+			++vi;
+		}
+	}
+
+	//measure sidechain triggers and work out how far they duck each bus:
+	run_sidechains(frames);
+
+	//run the buses' effects and add them into the buffer, with the global volume on top:
+	float block_volume[2];
+	block_volume[0] = Sound::volume.value;
+	step_value_ramp(Sound::volume, float(frames) / float(AUDIO_RATE));
+	block_volume[1] = Sound::volume.value;
+	mix_buses(buffer, frames, block_volume);
+
+	//...and, last of all, keep it from clipping:
+	totals->limited += limiter.process(buffer, frames, &totals->min_gain);
+
+	//count output that the device is going to clamp (only possible if the limiter is off):
+	for (uint32_t s = 0; s < 2 * frames; ++s) {
+		totals->clipped += (std::abs(buffer[s]) > 1.0f);
+	}
+
+	mix_clock_frames.store(block_end, std::memory_order_release);
+
+	totals->virtual_voices = std::max(totals->virtual_voices, virtual_voices);
+}
+
+//The audio callback -- invoked by SDL when it needs more sound to play:
+void mix_audio(void *, Uint8 *buffer_, int len) {
+	assert(buffer_); //should always have some audio buffer
+
+	struct LR {
+		float l;
+		float r;
+	};
+	static_assert(sizeof(LR) == 8, "Sample is packed");
+	assert(len % sizeof(LR) == 0); //should always be whole frames
+	LR *buffer = reinterpret_cast< LR * >(buffer_);
+	//(block size is whatever the device was opened with -- see open_device -- and may be more than MAX_MIX_SAMPLES)
+	uint32_t const frames = uint32_t(len) / sizeof(LR);
+
+	Uint64 callback_start = SDL_GetPerformanceCounter();
+
+	drain_commands();
+
+	//voices in use this block (for sizing voice limits):
+	uint32_t block_voices = uint32_t(active_voices.size());
+
+	//zero the output buffer:
+	for (uint32_t s = 0; s < frames; ++s) {
+		buffer[s].l = 0.0f;
+		buffer[s].r = 0.0f;
+	}
+
+	BlockTotals totals;
+	for (uint32_t done = 0; done < frames; /* later */) {
+		uint32_t count = std::min(frames - done, MAX_MIX_SAMPLES);
+		mix_block(&buffer[done].l, count, &totals);
+		done += count;
+	}
+	uint32_t virtual_voices = totals.virtual_voices;
+	uint32_t clipped = totals.clipped;
+	uint32_t limited = totals.limited;
+	float min_gain = totals.min_gain;
+
+	//book-keeping: did this callback take longer than the audio it produced?
+	float const ticks_per_ms = float(SDL_GetPerformanceFrequency()) / 1000.0f;
+	float const block_ms = 1000.0f * float(frames) / float(AUDIO_RATE);
+	float callback_ms = float(SDL_GetPerformanceCounter() - callback_start) / ticks_per_ms;
+	stat_callbacks.fetch_add(1, std::memory_order_relaxed);
+	if (callback_ms > block_ms) {
+		stat_overruns.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (callback_ms > stat_max_callback_ms.load(std::memory_order_relaxed)) {
+		stat_max_callback_ms.store(callback_ms, std::memory_order_relaxed);
+	}
+
+	//...and the rest of the instrumentation:
+	stat_callback_us.add(us_bin(1000.0f * callback_ms));
+	stat_utilization.add(percent_bin(100.0f * callback_ms / block_ms));
+	if (!offline) { //(offline blocks are rendered as fast as possible, so there is no schedule to stray from)
+		if (last_callback_start != 0) {
+			float interval_ms = float(callback_start - last_callback_start) / ticks_per_ms;
+			stat_jitter_us.add(us_bin(1000.0f * std::abs(interval_ms - block_ms)));
+		}
+		last_callback_start = callback_start;
+	}
+	if (block_voices > stat_peak_voices.load(std::memory_order_relaxed)) {
+		stat_peak_voices.store(block_voices, std::memory_order_relaxed);
+	}
+	stat_voice_callbacks.fetch_add(block_voices, std::memory_order_relaxed);
+	stat_virtual_voice_callbacks.fetch_add(virtual_voices, std::memory_order_relaxed);
+	if (clipped) {
+		stat_clipped_samples.fetch_add(clipped, std::memory_order_relaxed);
+		stat_clipped_callbacks.fetch_add(1, std::memory_order_relaxed);
+	}
+	float reduction_db = (min_gain < 1.0f ? -20.0f * std::log10(min_gain) : 0.0f);
+	stat_gain_reduction_db.add(db_bin(reduction_db));
+	if (limited) {
+		stat_limited_frames.fetch_add(limited, std::memory_order_relaxed);
+		stat_limited_callbacks.fetch_add(1, std::memory_order_relaxed);
+		if (reduction_db > stat_max_gain_reduction_db.load(std::memory_order_relaxed)) {
+			stat_max_gain_reduction_db.store(reduction_db, std::memory_order_relaxed);
+		}
+	}
 }
 
 
@@ -4,23 +4,102 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct MappedPCM; //memory-mapped '.pcm' file, from load_pcm.hpp
+struct Bundle; //packed asset files, from Bundle.hpp
+
 namespace Sound {
 
-//Sample objects hold mono (one-channel) audio.
+struct SampleStream; //(internal) incremental decoding state, defined in Sound.cpp
+struct CacheEntry; //(internal) compressed data and cached decoded audio, defined in Sound.cpp
+
+//Every voice is mixed into one of these submix buses (see set_bus_volume and friends, below):
+enum Bus : uint32_t {
+	BusMusic,
+	BusSFX,
+	BusUI,
+};
+constexpr uint32_t const BusCount = 3;
+
+//Tone objects describe a procedurally generated (mono) sound: a sine wave whose phase is wobbled by a
+// second sine wave (which gives a bell- or metal-like sound), fading out over 'duration' seconds:
+//   out(t) = amplitude * max(0, 1 - t / duration)^falloff * sin(2 pi carrier_hz t + index * sin(2 pi modulator_hz t))
+//(apart from the frequencies, the defaults are those of the game's menu and movement sounds)
+struct Tone {
+	float carrier_hz = 440.0f; //(negative frequencies run the carrier backward, which sounds different when modulated)
+	float modulator_hz = 0.0f;
+	float index = 1.0f; //how far (in radians) the modulator pushes the carrier's phase around
+	float duration = 0.2f; //in seconds
+	float amplitude = 0.3f;
+	uint32_t falloff = 2; //power of the fade-out: 0 == none, 1 == linear, 2 == quadratic, ...
+};
+
+//Sample objects hold mono (one-channel) or stereo (two-channel) audio.
 struct Sample {
-	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	//Decoded samples are decompressed into memory when loaded;
+	//Streamed samples (only supported for '.opus') are decoded a little at a time, just ahead of playback,
+	//  by a background thread. This is much faster to load and much smaller for long music tracks;
+	//  however, a streamed sample can only be playing in one place at a time.
+	//Cached samples (also only '.opus') are kept in memory compressed and decoded on first play -- or ahead
+	//  of time, by Sound::prefetch() -- into a shared pool of decoded audio with a memory budget.
+	//  Decoding is done by the background thread, so play() never waits for it; instead, a play that finds
+	//  its sample not yet decoded starts (from Sound::update()) once decoding finishes -- a little late.
+	//  When the pool is over budget, the least recently used samples that aren't playing are evicted.
+	//Mapped samples (only '.pcm', as written by the bake-pcm tool) memory-map the file and play straight
+	//  out of the mapped pages: loading does no decoding and no copying, and the OS pages the audio in
+	//  as it is first played.
+	enum LoadMode {
+		Decoded,
+		Streamed,
+		Cached,
+		Mapped,
+	};
+
+	//Load from a '.wav', '.opus', or '.pcm' file.
+	//  will warn and convert if sound is not already floating-point mono or stereo
+	//  (.wav files keep their own sampling rate; the mixer resamples them as they play):
+	Sample(std::string const &filename, LoadMode load_mode = Decoded);
+
+	//Load a '.opus' or '.pcm' file packed into a Bundle, in any of the modes above:
+	//  Streamed, Cached, and Mapped samples read straight out of the bundle (no copy), so it must outlive them.
+	//  ('.wav' files aren't supported in bundles; bake them into '.pcm' files instead)
+	Sample(Bundle const &bundle, std::string const &name, LoadMode load_mode = Decoded);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (interleaved, if 'channels' is 2) recorded at 'rate' frames per second:
+	Sample(std::vector< float > const &data, uint32_t channels = 1, uint32_t rate = 48000);
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//Synthesize a tone:
+	//  Streamed tones are generated by the mixer as they play -- nothing to load, no memory, and
+	//  (unlike streamed files) they can play in several places at once.
+	//  Decoded tones are generated into 'data' right away, which makes each play a little cheaper to mix.
+	//  (tones can't be Cached)
+	Sample(Tone const &tone, LoadMode load_mode = Streamed);
+
+	~Sample();
+	Sample(Sample const &) = delete;
+	Sample &operator=(Sample const &) = delete;
+
+	//sample data is stored as floating-point, with 'channels' values per frame (LRLR... for stereo):
 	std::vector< float > data;
+	uint32_t channels = 1;
+	uint32_t rate = 48000; //frames per second (streamed, cached, and synthesized samples are always 48kHz)
+
+	//bus this sample is mixed into whenever it is played:
+	Bus bus = BusSFX;
+	//while this sample is playing, buses with a sidechain (see set_sidechain) duck out of its way:
+	bool ducks = false;
+
+	//...unless the sample is streamed, cached, mapped, or synthesized, in which case 'data' is empty and one of these is set:
+	std::unique_ptr< SampleStream > stream;
+	std::unique_ptr< CacheEntry > cached;
+	std::unique_ptr< MappedPCM > mapped;
+	std::unique_ptr< Tone > tone;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -46,54 +125,286 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' objects are handles to samples that are currently playing:
+// (they are small and cheap to copy; the sample itself lives in a fixed-size pool of voices
+//  owned by the mixer, so once it finishes -- or its voice is stolen -- the handle goes stale
+//  and the functions below quietly do nothing)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	// (for stereo samples, 'pan' is a balance control: it turns down the opposite channel)
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
+
+	//change the playback speed (2.0 == twice as fast and an octave up; see Sound::play):
+	void set_pitch(float new_pitch, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//'stop_at' is the same, but the fade starts exactly at frame 'mix_time' of the mixer clock (see Sound::mix_clock()):
+	// (with a ramp of zero, the sample is cut off right at that frame)
+	void stop_at(uint64_t mix_time, float ramp = 1.0f / 60.0f) const;
+
+	//jump to 'time' seconds from the start of the sample:
+	// (streamed samples skip whatever was already decoded and may take a moment to restart)
+	void seek(float time) const;
+
+	//was playback stopped (either by running out of sample, by stop() or stop_at(), or by having its voice stolen)?
+	// (true as soon as stop() or stop_at() is called, even though the sample is still fading out)
+	bool stopped() const;
+
+	//does this handle refer to a (possibly finished) call to Sound::play()?
+	explicit operator bool() const { return index != InvalidIndex; }
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-	Ramp< float > pan = Ramp< float >(0.0f);
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_)
-		: data(sample_.data), volume(volume_), pan(pan_) { }
+	static constexpr uint32_t const InvalidIndex = -1U;
+	uint32_t index = InvalidIndex; //voice slot in the pool
+	uint32_t generation = 0; //which use of that slot this handle refers to
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions
+// 'voice_limit' is the number of samples that may play at once; the voice pool is allocated here, once.
+// 'block_frames' is the number of frames mixed per audio callback (see set_block_size):
+void init(uint32_t voice_limit = 64, uint32_t block_frames = 1024);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+void update(); //call Sound::update() once per frame from main.cpp (starts plays of newly decoded Cached samples; adjusts the block size, see below)
+
+//Offline rendering, for tests and benchmarks on machines without a sound card:
+//call Sound::init_offline() instead of Sound::init() (and before loading any samples) to run without
+// an audio device. Nothing is mixed until Sound::render() is called; it mixes 'frames' frames of
+// interleaved stereo (LRLR...) into 'out' as fast as the CPU allows, on the calling thread.
+//Rendering is deterministic: the same calls in the same order produce the same output.
+void init_offline(uint32_t voice_limit = 64, uint32_t block_frames = 1024);
+void render(float *out, uint32_t frames);
+
+//Audio is mixed in blocks of 'frames' frames (rounded to a power of two from 64 to 4096; the device may
+// pick something else). Smaller blocks mean sounds start sooner after play() but leave the callback less
+// room for hiccups: 128-256 is good for latency-sensitive modes, 1024 or more for background music.
+//If 'adaptive' is set, Sound::update() doubles the block size whenever the callback misses several
+// deadlines in a short time, then shrinks it back toward 'frames' once things have been quiet for a while.
+//(changing the block size reopens the audio device, so there may be a brief gap; devices that pick their
+// own block size are only reopened until it's clear they won't change it)
+void set_block_size(uint32_t frames, bool adaptive = true);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  if all voices are busy, one is stolen according to the steal policy (below).
+//  (the sample must outlive its playback)
+//  'pitch' plays the sample faster or slower (and so higher or lower); the mixer resamples on the fly,
+//  so the same Sample can be played at any pitch. (the sample is read at no less than 1/64 and no more than
+//  8 times normal speed; streamed samples always play at 1.0, and tones keep the pitch they were started with)
+PlayingSample play(
+	Sample const &sample,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	uint32_t priority = 0, //used by StealLowestPriority; higher numbers are more important
+	float pitch = 1.0f
+);
+
+//Call 'Sound::loop' to play a sample over and over (with no gap) until it is stopped:
+PlayingSample loop(
+	Sample const &sample,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	uint32_t priority = 0,
+	float pitch = 1.0f
+);
+
+//Loop points mark the part of a sample that repeats: it plays from the beginning up to 'end', then
+// jumps back to 'start' (the wrap happens inside the mixer, so there is never a gap).
+//Points are in frames of the sample (at its own rate); 'end' of 0 means the end of the sample.
+// (points past the end of the sample are moved back to it; a 'start' at or after 'end' loops the whole sample)
+struct LoopPoints {
+	uint32_t start = 0;
+	uint32_t end = 0;
+};
+
+//...e.g., music with an intro that shouldn't repeat: Sound::loop(music, Sound::LoopPoints{ intro_frames, 0 });
+PlayingSample loop(
+	Sample const &sample,
+	LoopPoints const &points,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	uint32_t priority = 0,
+	float pitch = 1.0f
+);
+
+//Play a tone directly, synthesizing it as it plays (so each play can use different parameters, and nothing is allocated):
+PlayingSample play(
+	Tone const &tone,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	uint32_t priority = 0
+);
+
+//The mixer keeps a sample clock: the number of 48kHz frames of audio it has produced so far.
+//It only moves forward, a whole callback's worth at a time, so to make something happen at an exact
+// moment, schedule it a little ahead of the current value:
+// (the output limiter delays everything by LimiterLatency frames on top of this; see set_limiter)
+uint64_t mix_clock();
+
+//Like play() and loop(), but the sample starts exactly at frame 'mix_time' of the mixer clock:
+// (if that frame has already been mixed, the sample starts as soon as possible instead)
+PlayingSample play_at(
+	Sample const &sample,
+	uint64_t mix_time,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	uint32_t priority = 0
+);
+PlayingSample loop_at(
 	Sample const &sample,
+	uint64_t mix_time,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	uint32_t priority = 0,
+	LoopPoints const &points = LoopPoints()
+);
+
+//Starting at frame 'mix_time', fade 'from' out and 'to' in over 'duration' seconds:
+// returns the handle for 'to' (which is looped -- between 'points' -- if 'loop' is set)
+PlayingSample crossfade(
+	PlayingSample const &from,
+	Sample const &to,
+	uint64_t mix_time,
+	float duration,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	bool loop = false,
+	LoopPoints const &points = LoopPoints()
 );
 
+//which voice to take over when play() is called with every voice busy:
+enum StealPolicy {
+	StealOldest, //the voice that started longest ago
+	StealQuietest, //the voice with the lowest current volume
+	StealLowestPriority, //the voice with the lowest priority (oldest among equals)
+};
+void set_steal_policy(StealPolicy policy);
+
+//Cached samples:
+//decode 'sample' in the background, so that a later play() starts right away:
+// (e.g., call this a couple of seconds before switching music; does nothing for other kinds of sample)
+void prefetch(Sample const &sample);
+
+//memory budget for decoded audio of Cached samples (default 32 MiB):
+// (playing samples are never evicted, so the pool may go over budget if many play at once)
+void set_cache_budget(size_t bytes);
+
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
 //set global volume:
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-extern Ramp< float > volume;
+extern Ramp< float > volume; //(owned by the audio callback; use set_volume to change)
+
+//Buses:
+//Voices are summed into their sample's bus; each bus then runs its insert effects (in slot order),
+// is scaled by its volume, and is added to the output (which Sound::volume scales last).
+//A bus's gain is volume * (muted ? 0 : 1) * duck, each ramped separately, so muting or ducking
+// a bus and then un-muting or un-ducking it always comes back to the volume that was set:
+void set_bus_volume(Bus bus, float new_volume, float ramp = 1.0f / 60.0f);
+void set_bus_muted(Bus bus, bool muted, float ramp = 1.0f / 60.0f);
+//turn a bus down (e.g., music while something important is said) -- 'level' of 1.0 is un-ducked:
+void set_bus_duck(Bus bus, float level, float ramp = 0.1f);
+
+//Insert effects:
+struct Effect {
+	enum Type : uint32_t {
+		None,
+		LowPass, //muffles: removes frequencies above 'cutoff_hz'
+		Reverb, //adds a room's echoes: 'wet' of them, with a tail whose length grows with 'room_size' (0-1)
+	} type = None;
+	float cutoff_hz = 800.0f; //(LowPass)
+	float room_size = 0.5f; //(Reverb)
+	float damping = 0.5f; //(Reverb) 0-1; more damping == duller tail
+	float wet = 0.3f; //(Reverb)
+};
+constexpr uint32_t const EffectSlots = 2; //per bus
+//put an effect in one of a bus's slots (Effect() clears it); changing just the settings of the
+// effect already in a slot keeps its state, so, e.g., a filter's cutoff can be swept without clicks:
+void set_bus_effect(Bus bus, uint32_t slot, Effect const &effect);
+
+//Automatic ducking:
+//A bus with a sidechain is turned down, by the mixer, whenever samples marked 'ducks' are playing:
+// it follows their loudness (rising over 'attack' seconds, falling over 'release' seconds), and is
+// turned all the way down to 'level' once that reaches 'threshold'. (this is on top of set_bus_duck)
+//The ducking is worked out for every frame in the mixer, so it lines up exactly with the triggers.
+// (triggers mixed into the ducked bus itself get turned down with it -- so keep them on another bus)
+struct Sidechain {
+	float level = 0.3f;
+	float threshold = 0.05f;
+	float attack = 0.01f;
+	float release = 0.4f;
+};
+void set_sidechain(Bus bus, Sidechain const &sidechain);
+void clear_sidechain(Bus bus);
+
+//Output limiter:
+//The whole mix goes through a look-ahead limiter on its way to the device. Whenever the mix would go
+// over 'ceiling', the limiter turns it down -- smoothly, starting just ahead of the peak -- and then
+// lets it back up over 'release' seconds. So lots of loud voices at once get quieter instead of clipping.
+//Looking ahead means the output is always LimiterLatency frames (about 1.3ms) behind the mixer;
+// it still is with the limiter turned off, so turning it on and off never skips or repeats any audio.
+constexpr uint32_t const LimiterLatency = 64;
+void set_limiter(bool enabled, float ceiling = 0.98f, float release = 0.1f);
+
+//How often some per-callback measurement fell into each of a fixed set of ranges:
+struct Histogram {
+	static constexpr uint32_t Bins = 16;
+	float lower[Bins] = {}; //bin i counts values in [lower[i], lower[i+1]); the last bin has no upper limit
+	uint64_t counts[Bins] = {};
+
+	uint64_t total() const;
+	//(approximate) value that 'fraction' of measurements were at or below -- the upper edge of the bin it lands in:
+	float percentile(float fraction) const;
+};
+
+//play/stop/set_* don't touch the mixer's data directly; they push commands into a
+// lock-free ring that the audio callback drains at the start of every block.
+//Counters describing how that (and the sample cache) is going:
+struct Stats {
+	uint64_t callbacks = 0; //number of times the audio callback has run
+	uint64_t overruns = 0; //callbacks that took longer than the audio they produced
+	uint64_t dropped_commands = 0; //commands discarded because the command ring was full
+	uint64_t stolen_voices = 0; //plays that had to take over a busy voice
+	uint64_t stream_underruns = 0; //blocks where a streamed sample hadn't been decoded in time
+	float max_callback_ms = 0.0f; //longest single callback
+	uint32_t block_frames = 0; //current mixing block size (0 if there is no audio device)
+	uint64_t cache_hits = 0; //plays of Cached samples that were already decoded
+	uint64_t cache_misses = 0; //plays of Cached samples that had to wait for decoding (or for a prefetch) to start
+	uint64_t cache_evictions = 0; //decoded samples dropped to stay within the cache budget
+	uint64_t cache_resident_bytes = 0; //decoded audio currently held for Cached samples
+
+	//what the audio callback has been up to (useful for picking voice limits and block sizes):
+	Histogram callback_us; //time spent in each callback, in microseconds
+	Histogram utilization; //callback time as a percentage of the audio it produced (>= 100 is an overrun)
+	Histogram jitter_us; //how far the time between callbacks strayed from the block length, in microseconds
+	uint32_t peak_voices = 0; //most voices in use during any one callback
+	float average_voices = 0.0f; //voices in use, averaged over all callbacks
+	float average_virtual_voices = 0.0f; //...of which were too quiet to hear, so weren't mixed (just moved along)
+	uint64_t clipped_samples = 0; //output values outside [-1,1] (the device will clamp these)
+	uint64_t clipped_callbacks = 0; //callbacks that produced any clipped samples
+	//what the output limiter has been up to (how hard it has to work says how much headroom the mix needs):
+	uint64_t limited_frames = 0; //output frames the limiter turned down
+	uint64_t limited_callbacks = 0; //callbacks where it turned anything down
+	float max_gain_reduction_db = 0.0f; //furthest it has ever turned the output down
+	Histogram gain_reduction_db; //furthest it turned the output down in each callback, in decibels
+};
+Stats get_stats();
+
+//write get_stats() out in human-readable form:
+void write_stats(std::ostream &to);
+
+//if set, Sound::shutdown() writes the stats to this file (handy for gathering numbers from play-testing):
+void set_stats_file(std::string const &filename);
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
+// the set_*/stop/play/... functions don't need these, so you shouldn't need
 // to call them unless your code is modifying values directly:
 void lock();
 void unlock();
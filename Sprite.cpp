@@ -2,7 +2,10 @@
 
 #include "GL.hpp"
 #include "read_write_chunk.hpp"
+#include "atlas_format.hpp"
 #include "load_save_png.hpp"
+#include "Bundle.hpp"
+#include "MappedFile.hpp"
 
 #include <fstream>
 
@@ -10,9 +13,27 @@ SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 	std::string png_path = filebase + ".png";
 	atlas_path = filebase + ".atlas";
 
+	std::ifstream png(png_path, std::ios::binary);
+	if (!png) {
+		throw std::runtime_error("Failed to open PNG image file '" + png_path + "'.");
+	}
+	//read atlas_path in place:
+	MappedFile atlas(atlas_path);
+	load(png_path, png, atlas.data, atlas.size);
+}
+
+SpriteAtlas::SpriteAtlas(Bundle const &bundle, std::string const &name) {
+	atlas_path = bundle.filename + ":" + name + ".atlas";
+
+	SliceStream png(bundle.get(name + ".png"));
+	Bundle::Slice const &atlas = bundle.get(name + ".atlas");
+	load(bundle.filename + ":" + name + ".png", png, atlas.data, atlas.size);
+}
+
+void SpriteAtlas::load(std::string const &png_path, std::istream &png, unsigned char const *atlas, size_t atlas_size) {
 	// ----- load the texture data -----
 	std::vector< glm::u8vec4 > tex_data;
-	load_png(png_path, &tex_size, &tex_data, LowerLeftOrigin);
+	load_png(png, png_path, &tex_size, &tex_data, LowerLeftOrigin);
 
 	//upload the texture data to the GPU:
 
@@ -43,51 +64,77 @@ SpriteAtlas::SpriteAtlas(std::string const &filebase) {
 
 	// ----- load the sprite location data -----
 
-	//read from atlas_path in binary mode:
-	std::ifstream in(atlas_path, std::ios::binary);
-
-	//sprite atlas is stored as two chunks:
-	// (1) a 'str0' chunk with string data:
-	std::vector< char > strings;
+	//sprite atlas is stored as chunks (see atlas_format.hpp), which are read in place:
+	ChunkReader reader(atlas, atlas_size, atlas_path);
 
-	read_chunk(in, "str0", &strings);
+	//helper: insert a sprite into the lookup table:
+	auto add_sprite = [this](ChunkView< char > const &strings, uint32_t name_begin, uint32_t name_end, Sprite const &sprite) {
+		//use the name_begin and name_end fields to read the sprite's name from the strings table:
+		if (name_begin > name_end || name_end > strings.size) {
+			throw std::runtime_error("Invalid name in sprite atlas '" + atlas_path + "'.");
+		}
+		std::string name(strings.begin() + name_begin, strings.begin() + name_end);
 
-	// (2) a 'spr0' chunk with sprite data:
-	struct SpriteData {
-		uint32_t name_begin, name_end;
-		glm::vec2 min_px;
-		glm::vec2 max_px;
-		glm::vec2 anchor_px;
+		auto ret = sprites.insert(std::make_pair(name, sprite));
+		if (!ret.second) {
+			throw std::runtime_error("Sprite with duplicate name '" + name + "' in sprite atlas '" + atlas_path + "',");
+		}
 	};
-	std::vector< SpriteData > datas;
-
-	read_chunk(in, "spr0", &datas);
 
-	//actually create Sprite objects from the data and insert into the lookup table:
+	if (reader.peek() == "str0") {
+		//version 0: a 'str0' chunk with string data and a 'spr0' chunk with sprite data (native byte order):
+		ChunkView< char > strings = reader.view< char >("str0");
+
+		//(these atlases didn't pad 'str0', so 'spr0' may be misaligned, in which case it is copied)
+		std::vector< SpriteAtlasEntry0 > datas_copy;
+		ChunkView< SpriteAtlasEntry0 > datas = reader.read< SpriteAtlasEntry0 >("spr0", &datas_copy);
+
+		//let the hash table know how many elements we are going to insert (could save a re-allocation of the backings store):
+		sprites.reserve(datas.size);
+
+		for (auto const &data : datas) {
+			Sprite sprite;
+			sprite.min_px = glm::vec2(data.min_px[0], data.min_px[1]);
+			sprite.max_px = glm::vec2(data.max_px[0], data.max_px[1]);
+			sprite.anchor_px = glm::vec2(data.anchor_px[0], data.anchor_px[1]);
+			//(computed once here, rather than every time the sprite is drawn)
+			sprite.min_tc = sprite.min_px / glm::vec2(tex_size);
+			sprite.max_tc = sprite.max_px / glm::vec2(tex_size);
+			add_sprite(strings, data.name_begin, data.name_end, sprite);
+		}
+		return;
+	}
 
-	//let the hash table know how many elements we are going to insert (could save a re-allocation of the backings store):
-	sprites.reserve(datas.size());
+	//version 1: header, names, and an index of sprites sorted by name (all little-endian):
+	ChunkView< SpriteAtlasHeader > headers = reader.view< SpriteAtlasHeader >("spr1");
+	if (headers.size != 1) {
+		throw std::runtime_error("Sprite atlas '" + atlas_path + "' has an unexpected header size.");
+	}
+	uint32_t version = little_endian(headers[0].version);
+	if (version != SpriteAtlasVersion) {
+		throw std::runtime_error("Sprite atlas '" + atlas_path + "' is version " + std::to_string(version) + " (expecting " + std::to_string(SpriteAtlasVersion) + ").");
+	}
+	glm::uvec2 atlas_tex_size(little_endian(headers[0].tex_width), little_endian(headers[0].tex_height));
+	if (atlas_tex_size != tex_size) {
+		throw std::runtime_error("Sprite atlas '" + atlas_path + "' was made for a " + std::to_string(atlas_tex_size.x) + "x" + std::to_string(atlas_tex_size.y) + " texture, but '" + png_path + "' is " + std::to_string(tex_size.x) + "x" + std::to_string(tex_size.y) + ".");
+	}
 
-	//actually insert all items into the data table:
-	for (auto const &data : datas) {
+	ChunkView< char > strings = reader.view< char >("str0");
+	ChunkView< SpriteAtlasEntry > entries = reader.view< SpriteAtlasEntry >("idx1");
+	if (entries.size != little_endian(headers[0].count)) {
+		throw std::runtime_error("Sprite atlas '" + atlas_path + "' should have " + std::to_string(little_endian(headers[0].count)) + " sprites, but its index has " + std::to_string(entries.size) + ".");
+	}
 
-		//first, use the name_begin and name_end fields to read the sprite's name from the strings table:
-		if (data.name_begin > data.name_end || data.name_end > strings.size()) {
-			throw std::runtime_error("Invalid name in sprite atlas '" + atlas_path + "'.");
-		}
-		std::string name(strings.begin() + data.name_begin, strings.begin() + data.name_end);
+	sprites.reserve(entries.size);
 
-		//then populate a new Sprite struct using the data:
+	for (auto const &entry : entries) {
 		Sprite sprite;
-		sprite.min_px = data.min_px;
-		sprite.max_px = data.max_px;
-		sprite.anchor_px = data.anchor_px;
-
-		//finally, insert into the sprites lookup table:
-		auto ret = sprites.insert(std::make_pair(name, sprite));
-		if (!ret.second) {
-			throw std::runtime_error("Sprite with duplicate name '" + name + "' in sprite atlas '" + atlas_path + "',");
-		}
+		sprite.min_px = glm::vec2(little_endian(entry.min_px[0]), little_endian(entry.min_px[1]));
+		sprite.max_px = glm::vec2(little_endian(entry.max_px[0]), little_endian(entry.max_px[1]));
+		sprite.anchor_px = glm::vec2(little_endian(entry.anchor_px[0]), little_endian(entry.anchor_px[1]));
+		sprite.min_tc = glm::vec2(little_endian(entry.min_tc[0]), little_endian(entry.min_tc[1]));
+		sprite.max_tc = glm::vec2(little_endian(entry.max_tc[0]), little_endian(entry.max_tc[1]));
+		add_sprite(strings, little_endian(entry.name_begin), little_endian(entry.name_end), sprite);
 	}
 }
 
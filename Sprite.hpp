@@ -13,6 +13,10 @@
 
 #include <unordered_map>
 #include <string>
+#include <iosfwd>
+#include <cstddef>
+
+struct Bundle;
 
 struct Sprite {
 	//Sprites are rectangles in an atlas texture:
@@ -20,6 +24,10 @@ struct Sprite {
 	glm::vec2 max_px; //position of upper right corner (in pixels; ll-origin)
 	glm::vec2 anchor_px; //position of 'anchor' (in pixels; ll-origin)
 
+	//The same corners as texture coordinates (i.e., divided by the atlas texture's size):
+	glm::vec2 min_tc;
+	glm::vec2 max_tc;
+
 	//NOTE:
 	//The 'anchor' is the "center" or "pivot point" of the sprite --
 	// a value defined when authoring the sprite which is used as the
@@ -32,6 +40,8 @@ struct Sprite {
 struct SpriteAtlas {
 	//load from filebase.png and filebase.atlas:
 	SpriteAtlas(std::string const &filebase);
+	//load from name.png and name.atlas packed into a bundle (read in place; the bundle needn't outlive the atlas):
+	SpriteAtlas(Bundle const &bundle, std::string const &name);
 	~SpriteAtlas();
 
 	//look up sprite in list of loaded sprites:
@@ -44,10 +54,13 @@ struct SpriteAtlas {
 
 	//---- internal data ---
 
-	//table of loaded sprites, sorted by name:
+	//table of loaded sprites, by name:
 	std::unordered_map< std::string, Sprite > sprites;
 
 	//path to atlas, stored for debugging purposes:
 	std::string atlas_path;
+
+	//(helper for the constructors) upload the texture and read the sprite table (from the .atlas file's bytes):
+	void load(std::string const &png_path, std::istream &png, unsigned char const *atlas, size_t atlas_size);
 };
 
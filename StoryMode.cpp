@@ -3,10 +3,11 @@
 #include "Sprite.hpp"
 #include "DrawSprites.hpp"
 #include "Load.hpp"
-#include "data_path.hpp"
 #include "gl_errors.hpp"
 #include "MenuMode.hpp"
 #include "Sound.hpp"
+#include "Bundle.hpp"
+#include "game_assets.hpp"
 
 Sprite const *sprite_left_select = nullptr;
 Sprite const *sprite_right_select = nullptr;
@@ -24,7 +25,7 @@ Sprite const *sprite_hill_traveller = nullptr;
 Sprite const *sprite_hill_missing = nullptr;
 
 Load< SpriteAtlas > sprites(LoadTagDefault, []() -> SpriteAtlas const * {
-	SpriteAtlas const *ret = new SpriteAtlas(data_path("the-planet"));
+	SpriteAtlas const *ret = new SpriteAtlas(*game_assets, "the-planet");
 
 	sprite_left_select = &ret->lookup("text-select-left");
 	sprite_right_select = &ret->lookup("text-select-right");
@@ -42,16 +43,21 @@ Load< SpriteAtlas > sprites(LoadTagDefault, []() -> SpriteAtlas const * {
 	sprite_hill_missing = &ret->lookup("hill-missing");
 
 	return ret;
-});
+}, LoadOnMainThread, "sprites", { &game_assets }); //(uploads a texture, so needs the OpenGL context)
 
 Load< Sound::Sample > music_cold_dunes(LoadTagDefault, []() -> Sound::Sample * {
-	return new Sound::Sample(data_path("cold-dunes.opus"));
-});
+	Sound::Sample *ret = new Sound::Sample(*game_assets, "cold-dunes.opus", Sound::Sample::Streamed);
+	ret->bus = Sound::BusMusic;
+	return ret;
+}, LoadOnAnyThread, "music_cold_dunes", { &game_assets });
 
 StoryMode::StoryMode() {
+	//(the mixer loops the music itself, so it never has to be restarted from here)
+	background_music = Sound::loop(*music_cold_dunes, 1.0f);
 }
 
 StoryMode::~StoryMode() {
+	background_music.stop();
 }
 
 bool StoryMode::handle_event(SDL_Event const &, glm::uvec2 const &window_size) {
@@ -65,10 +71,6 @@ void StoryMode::update(float elapsed) {
 		//there is no menu displayed! Make one:
 		enter_scene();
 	}
-
-	if (!background_music || background_music->stopped) {
-		background_music = Sound::play(*music_cold_dunes, 1.0f);
-	}
 }
 
 void StoryMode::enter_scene() {
@@ -43,5 +43,5 @@ struct StoryMode : Mode {
 	glm::vec2 view_max = glm::vec2(256, 224);
 
 	//------ background music -------
-	std::shared_ptr< Sound::PlayingSample > background_music;
+	Sound::PlayingSample background_music;
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Layout of '.atlas' files (written by pack-sprites, read by SpriteAtlas).
+ *
+ * Version 1 atlases are chunks in the read_write_chunk.hpp format:
+ *  "spr1" -- one SpriteAtlasHeader
+ *  "str0" -- sprite names (not zero-terminated; see SpriteAtlasEntry), padded with zeros to a multiple of 4 bytes
+ *  "idx1" -- one SpriteAtlasEntry per sprite, sorted by name (bytewise), so names are unique and can be binary-searched
+ * Every field is stored little-endian (see little_endian() in read_write_chunk.hpp), so atlases are portable;
+ * on little-endian machines the entries can be used straight from the file.
+ *
+ * Older atlases ("version 0") are just a "str0" chunk and a "spr0" chunk of SpriteAtlasEntry0, in native byte order
+ * and unsorted. SpriteAtlas still reads them, computing the texture coordinates when it does.
+ */
+
+constexpr uint32_t const SpriteAtlasVersion = 1;
+
+struct SpriteAtlasHeader {
+	uint32_t version = SpriteAtlasVersion;
+	uint32_t count = 0; //number of sprites
+	uint32_t tex_width = 0, tex_height = 0; //size of the atlas texture the texture coordinates were computed for
+};
+static_assert(sizeof(SpriteAtlasHeader) == 16, "SpriteAtlasHeader is packed");
+
+struct SpriteAtlasEntry {
+	uint32_t name_begin = 0, name_end = 0; //name is str0[name_begin, name_end)
+	float min_px[2] = {0.0f, 0.0f}; //lower left corner (in pixels; ll-origin)
+	float max_px[2] = {0.0f, 0.0f}; //upper right corner
+	float anchor_px[2] = {0.0f, 0.0f};
+	float min_tc[2] = {0.0f, 0.0f}; //min_px / texture size (i.e., ready to hand to the GPU)
+	float max_tc[2] = {0.0f, 0.0f}; //max_px / texture size
+};
+static_assert(sizeof(SpriteAtlasEntry) == 48, "SpriteAtlasEntry is packed");
+
+struct SpriteAtlasEntry0 {
+	uint32_t name_begin = 0, name_end = 0;
+	float min_px[2] = {0.0f, 0.0f};
+	float max_px[2] = {0.0f, 0.0f};
+	float anchor_px[2] = {0.0f, 0.0f};
+};
+static_assert(sizeof(SpriteAtlasEntry0) == 32, "SpriteAtlasEntry0 is packed");
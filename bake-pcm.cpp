@@ -0,0 +1,76 @@
+#include "load_wav.hpp"
+#include "load_opus.hpp"
+#include "load_pcm.hpp"
+#include "mix_kernels.hpp"
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+/*
+ * bake a .wav or .opus file into a .pcm file (see load_pcm.hpp) that Sound::Sample can memory-map.
+ * audio not already at 48kHz is resampled (with the mixer's own filter), so the mixer can play it as-is.
+ *
+ */
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try { //windows doesn't print nice errors for unhandled exceptions, so we need to.
+#endif
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t./bake-pcm <in.wav|in.opus> <out.pcm>\n";
+		std::cerr << " will decode the input and write it to \"out.pcm\" as 48kHz floating-point audio.\n";
+		std::cerr.flush();
+		return 1;
+	}
+	std::string inname = argv[1];
+	std::string outname = argv[2];
+
+	if (!(outname.size() > 4 && outname.substr(outname.size()-4) == ".pcm")) {
+		std::cerr << "ERROR: your output file (" << outname << ") should have a .pcm extension." << std::endl;
+		return 1;
+	}
+
+	std::vector< float > data;
+	uint32_t channels = 1;
+	uint32_t rate = 48000;
+	if (inname.size() >= 4 && inname.substr(inname.size()-4) == ".wav") {
+		load_wav(inname, &data, &channels, &rate);
+	} else if (inname.size() >= 5 && inname.substr(inname.size()-5) == ".opus") {
+		load_opus(inname, &data, &channels); //(opus is always 48kHz)
+	} else {
+		std::cerr << "ERROR: your input file (" << inname << ") should be a .wav or .opus file." << std::endl;
+		return 1;
+	}
+
+	if (rate != 48000) {
+		std::cout << "Resampling from " << rate << "Hz..."; std::cout.flush();
+		MixKernel kernel = best_mix_kernel();
+		ResampleFn resample = (channels == 2 ? get_resample_stereo(kernel) : get_resample_mono(kernel));
+
+		//source position moves this far per output frame (32.32 fixed point):
+		uint64_t step = (uint64_t(rate) << 32) / 48000;
+		uint64_t in_frames = data.size() / channels;
+		uint64_t out_frames = ((in_frames << 32) + step - 1) / step;
+
+		//the filter reads a few frames to either side of each position, so pad the source with silence:
+		std::vector< float > padded((RESAMPLE_BEFORE + in_frames + RESAMPLE_AFTER + 1) * channels, 0.0f);
+		std::copy(data.begin(), data.end(), padded.begin() + RESAMPLE_BEFORE * channels);
+
+		data.assign(out_frames * channels, 0.0f);
+		resample(padded.data(), data.data(), uint32_t(out_frames), uint64_t(RESAMPLE_BEFORE) << 32, step, get_resample_table(step));
+		rate = 48000;
+		std::cout << " done." << std::endl;
+	}
+
+	save_pcm(outname, data, channels, rate);
+	std::cout << "Wrote " << (data.size() / channels) << " frames of " << (channels == 2 ? "stereo" : "mono") << " audio to '" << outname << "'." << std::endl;
+
+	return 0;
+#ifdef _WIN32
+	} catch (std::exception &e) {
+		std::cerr << "UNHANDLED EXCEPTION:\n" << e.what() << std::endl;
+		return 1;
+	}
+#endif
+}
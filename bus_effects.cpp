@@ -0,0 +1,237 @@
+#include "bus_effects.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//recursive filters fed silence decay toward zero through denormal numbers, which are very slow
+// on some CPUs; values this small are inaudible anyway, so just snap them to zero:
+static inline float flush_denormal(float x) {
+	return (std::abs(x) < 1e-20f ? 0.0f : x);
+}
+
+//---- low-pass ----
+
+void LowPassEffect::set(float cutoff_hz, float rate) {
+	//(kept a little below the Nyquist frequency, where the filter would stop being a filter)
+	float cutoff = std::max(10.0f, std::min(cutoff_hz, 0.45f * rate));
+	float w0 = 2.0f * 3.14159265f * cutoff / rate;
+	float alpha = std::sin(w0) / (2.0f * 0.70710678f);
+	float cos_w0 = std::cos(w0);
+	float a0 = 1.0f + alpha;
+	b1 = (1.0f - cos_w0) / a0;
+	b0 = 0.5f * b1;
+	b2 = b0;
+	a1 = -2.0f * cos_w0 / a0;
+	a2 = (1.0f - alpha) / a0;
+}
+
+void LowPassEffect::reset() {
+	z1[0] = z1[1] = 0.0f;
+	z2[0] = z2[1] = 0.0f;
+}
+
+void LowPassEffect::process(float *inout, uint32_t frames) {
+	for (uint32_t c = 0; c < 2; ++c) {
+		float s1 = z1[c], s2 = z2[c];
+		for (uint32_t k = 0; k < frames; ++k) {
+			float x = inout[2*k+c];
+			float y = b0 * x + s1;
+			s1 = b1 * x - a1 * y + s2;
+			s2 = b2 * x - a2 * y;
+			inout[2*k+c] = y;
+		}
+		z1[c] = flush_denormal(s1);
+		z2[c] = flush_denormal(s2);
+	}
+}
+
+//---- reverb ----
+
+//delay lengths from Freeverb (which were chosen, by ear, at 44.1kHz):
+static uint32_t const CombTuning[ReverbEffect::Combs] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+static uint32_t const AllPassTuning[ReverbEffect::AllPasses] = { 556, 441, 341, 225 };
+static uint32_t const StereoSpread = 23; //extra delay for the right channel
+
+static uint32_t scaled_delay(uint32_t frames, float rate) {
+	return uint32_t(float(frames) * rate / 44100.0f);
+}
+
+size_t ReverbEffect::memory_floats(float rate) {
+	size_t total = 0;
+	for (uint32_t c = 0; c < 2; ++c) {
+		for (uint32_t i = 0; i < Combs; ++i) total += scaled_delay(CombTuning[i] + c * StereoSpread, rate);
+		for (uint32_t i = 0; i < AllPasses; ++i) total += scaled_delay(AllPassTuning[i] + c * StereoSpread, rate);
+	}
+	return total;
+}
+
+void ReverbEffect::attach(float *memory, float rate) {
+	for (uint32_t c = 0; c < 2; ++c) {
+		for (uint32_t i = 0; i < Combs; ++i) {
+			combs[c][i].buffer = memory;
+			combs[c][i].size = scaled_delay(CombTuning[i] + c * StereoSpread, rate);
+			memory += combs[c][i].size;
+		}
+		for (uint32_t i = 0; i < AllPasses; ++i) {
+			all_passes[c][i].buffer = memory;
+			all_passes[c][i].size = scaled_delay(AllPassTuning[i] + c * StereoSpread, rate);
+			memory += all_passes[c][i].size;
+		}
+	}
+	reset();
+}
+
+void ReverbEffect::set(float room_size, float damping, float wet_) {
+	//(ranges from Freeverb: feedback in [0.7, 0.98], damping in [0, 0.4])
+	feedback = 0.7f + 0.28f * std::max(0.0f, std::min(room_size, 1.0f));
+	damp = 0.4f * std::max(0.0f, std::min(damping, 1.0f));
+	wet = std::max(0.0f, wet_);
+}
+
+void ReverbEffect::reset() {
+	for (uint32_t c = 0; c < 2; ++c) {
+		for (auto &delay : combs[c]) {
+			if (delay.buffer) std::memset(delay.buffer, 0, delay.size * sizeof(float));
+			delay.at = 0;
+			delay.store = 0.0f;
+		}
+		for (auto &delay : all_passes[c]) {
+			if (delay.buffer) std::memset(delay.buffer, 0, delay.size * sizeof(float));
+			delay.at = 0;
+		}
+	}
+}
+
+void ReverbEffect::process(float *inout, uint32_t frames) {
+	if (!combs[0][0].buffer) return; //(not attached)
+
+	//Freeverb's fixed gains: quiet enough going in that the combs don't blow up; loud enough coming out to hear:
+	float const input_gain = 0.015f;
+	float const output_gain = 3.0f * wet;
+
+	for (uint32_t k = 0; k < frames; ++k) {
+		//both channels of reverb are fed the same (mono) input:
+		float input = (inout[2*k+0] + inout[2*k+1]) * input_gain;
+		for (uint32_t c = 0; c < 2; ++c) {
+			float sum = 0.0f;
+			for (auto &comb : combs[c]) {
+				float y = comb.buffer[comb.at];
+				comb.store = flush_denormal(y * (1.0f - damp) + comb.store * damp);
+				comb.buffer[comb.at] = input + comb.store * feedback;
+				if (++comb.at == comb.size) comb.at = 0;
+				sum += y;
+			}
+			for (auto &all_pass : all_passes[c]) {
+				float delayed = all_pass.buffer[all_pass.at];
+				all_pass.buffer[all_pass.at] = sum + delayed * 0.5f;
+				if (++all_pass.at == all_pass.size) all_pass.at = 0;
+				sum = delayed - sum;
+			}
+			inout[2*k+c] += sum * output_gain;
+		}
+	}
+}
+
+//---- limiter ----
+
+size_t Limiter::memory_floats(uint32_t max_frames) {
+	return 2 * (size_t(Lookahead) + max_frames) + 2 * size_t(max_frames);
+}
+
+void Limiter::attach(float *memory, uint32_t max_frames_, FramePeakFn frame_peak_, ApplyGainFn apply_gain_) {
+	max_frames = max_frames_;
+	delayed = memory;
+	memory += 2 * (Lookahead + max_frames);
+	peak = memory;
+	memory += max_frames;
+	gain = memory;
+	frame_peak = frame_peak_;
+	apply_gain = apply_gain_;
+	reset();
+}
+
+void Limiter::set(float ceiling_, float release, float rate) {
+	ceiling = std::max(1e-3f, ceiling_);
+	release_coef = (release > 0.0f ? 1.0f - std::exp(-1.0f / (release * rate)) : 1.0f);
+}
+
+void Limiter::reset() {
+	if (delayed) std::memset(delayed, 0, 2 * Lookahead * sizeof(float));
+	hold_begin = hold_end = 0;
+	envelope = 1.0f;
+	for (auto &w : window) w = 1.0f;
+	window_sum = float(Lookahead);
+	window_at = 0;
+	quiet_frames = Lookahead;
+}
+
+uint32_t Limiter::process(float *inout, uint32_t frames, float *min_gain) {
+	*min_gain = 1.0f;
+	if (!delayed) return 0; //(not attached)
+
+	uint32_t limited = 0;
+	for (uint32_t done = 0; done < frames; /* later */) {
+		uint32_t count = std::min(frames - done, max_frames);
+		float *io = inout + 2 * done;
+
+		//line this block up behind the end of the last one:
+		std::memcpy(delayed + 2 * Lookahead, io, 2 * count * sizeof(float));
+		float largest = frame_peak(io, peak, count);
+
+		if (quiet_frames >= Lookahead && !(largest > ceiling)) {
+			//nothing turned down (or on its way back up) and nothing to turn down -- just delay:
+			std::memcpy(io, delayed, 2 * count * sizeof(float));
+			//(everything in the window now needs a gain of 1, so the running minimum is just the newest frame)
+			frame += count;
+			hold_gain[0] = 1.0f;
+			hold_frame[0] = frame - 1;
+			hold_begin = 0;
+			hold_end = 1;
+		} else {
+			float lowest = 1.0f;
+			for (uint32_t k = 0; k < count; ++k) {
+				float needed = (peak[k] > ceiling ? ceiling / peak[k] : 1.0f);
+
+				//running minimum: drop (larger) gains that 'needed' will outlast, and gains that have left the window:
+				while (hold_end != hold_begin && !(hold_gain[(hold_end - 1) % HoldSize] < needed)) --hold_end;
+				hold_gain[hold_end % HoldSize] = needed;
+				hold_frame[hold_end % HoldSize] = frame;
+				++hold_end;
+				if (frame - hold_frame[hold_begin % HoldSize] > Lookahead) ++hold_begin;
+				float held = hold_gain[hold_begin % HoldSize];
+				++frame;
+
+				//turn down right away, come back up over the release time:
+				if (held < envelope) {
+					envelope = held;
+				} else {
+					envelope += (held - envelope) * release_coef;
+					if (held - envelope < 1e-6f) envelope = held;
+				}
+				quiet_frames = (envelope == 1.0f ? std::min(quiet_frames + 1, Lookahead) : 0);
+
+				//moving average over the window, so the gain is already all the way down when the peak comes out of the delay:
+				window_sum += envelope - window[window_at];
+				window[window_at] = envelope;
+				if (++window_at == Lookahead) {
+					//(re-add from scratch now and then, so rounding errors don't pile up)
+					window_at = 0;
+					window_sum = 0.0f;
+					for (float w : window) window_sum += w;
+				}
+				float g = window_sum * (1.0f / float(Lookahead));
+				gain[k] = g;
+				lowest = std::min(lowest, g);
+				limited += (g < 1.0f);
+			}
+			apply_gain(delayed, gain, io, count, ceiling);
+			*min_gain = std::min(*min_gain, lowest);
+		}
+
+		//keep the end of this block for the next one:
+		std::memmove(delayed, delayed + 2 * count, 2 * Lookahead * sizeof(float));
+		done += count;
+	}
+	return limited;
+}
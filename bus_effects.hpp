@@ -0,0 +1,107 @@
+#pragma once
+
+//Insert effects for the mixer's submix buses (see Sound::set_bus_effect), and the limiter
+// that the whole mix goes through on its way out (see Sound::set_limiter).
+//
+//Each effect processes a block of interleaved stereo in place. They never allocate: anything
+// they need to remember (including delay lines) is set up once, in memory handed to them by
+// the mixer, so changing an effect's settings from block to block is cheap and real-time safe.
+//
+//Both are plain recursive filters, so -- unlike the kernels in mix_kernels.hpp -- there is
+// just one (scalar) version of each.
+
+#include "mix_kernels.hpp"
+
+#include <cstdint>
+#include <cstddef>
+
+//Two-pole (12dB/octave) low-pass filter ("RBJ cookbook" biquad with Q = 1/sqrt(2)):
+struct LowPassEffect {
+	//set the cutoff frequency (keeps the filter's state, so this can change while playing):
+	void set(float cutoff_hz, float rate);
+	//forget past input:
+	void reset();
+	void process(float *inout, uint32_t frames);
+
+	float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f; //coefficients
+	float z1[2] = {0.0f, 0.0f}, z2[2] = {0.0f, 0.0f}; //state (transposed direct form II), per channel
+};
+
+//Small-room reverb in the style of "Freeverb": eight damped comb filters in parallel, then four
+// all-pass filters in series, per channel (the right channel's delays are slightly longer, for width).
+//The dry signal passes through unchanged, with 'wet' times the reverberation added on top.
+struct ReverbEffect {
+	static constexpr uint32_t const Combs = 8;
+	static constexpr uint32_t const AllPasses = 4;
+
+	//floats of delay line needed at a given sampling rate:
+	static size_t memory_floats(float rate);
+	//lay out delay lines in 'memory' (which must hold memory_floats(rate) floats, and outlive the effect):
+	void attach(float *memory, float rate);
+
+	//'room_size' (0 == small, 1 == huge) sets how long the tail is, 'damping' (0-1) how quickly
+	// high frequencies die away in it:
+	void set(float room_size, float damping, float wet);
+	//silence the delay lines:
+	void reset();
+	void process(float *inout, uint32_t frames);
+
+	struct Delay {
+		float *buffer = nullptr;
+		uint32_t size = 0;
+		uint32_t at = 0;
+		float store = 0.0f; //(comb filters only) low-passed feedback
+	};
+	Delay combs[2][Combs];
+	Delay all_passes[2][AllPasses];
+	float feedback = 0.84f;
+	float damp = 0.2f;
+	float wet = 0.3f;
+};
+
+//Look-ahead brickwall limiter: delays the audio by Lookahead frames, and uses that time to turn the gain
+// down smoothly *before* any peak that would go over 'ceiling' arrives -- so nothing leaves it louder
+// than 'ceiling', without the distortion of clipping. Afterward, the gain recovers over 'release' seconds.
+//The gain is worked out per frame (a running minimum over the look-ahead window, then the release,
+// then a moving average over the window to smooth the turn-down), which is cheap scalar work;
+// measuring peaks and applying the gain is done with the kernels from mix_kernels.hpp.
+//When nothing is being turned down and nothing in a block is over the ceiling, that block is just delayed.
+struct Limiter {
+	static constexpr uint32_t const Lookahead = 64;
+
+	//floats of scratch space and delay line needed to process blocks of up to 'max_frames' frames:
+	static size_t memory_floats(uint32_t max_frames);
+	//set up in 'memory' (which must hold memory_floats(max_frames) floats, and outlive the limiter):
+	void attach(float *memory, uint32_t max_frames, FramePeakFn frame_peak, ApplyGainFn apply_gain);
+
+	//a ceiling of infinity turns limiting off (the audio is still delayed, so the latency never changes):
+	void set(float ceiling, float release, float rate);
+	//silence the delay line and forget any gain reduction:
+	void reset();
+	//process 'frames' of interleaved stereo in place (what comes out is Lookahead frames behind what goes in);
+	// returns the number of frames that were turned down, and sets 'min_gain' to the smallest gain used:
+	uint32_t process(float *inout, uint32_t frames, float *min_gain);
+
+	float *delayed = nullptr; //previous Lookahead frames of input, then this block's (room for Lookahead + max_frames frames)
+	float *peak = nullptr; //per-frame scratch (max_frames floats each)
+	float *gain = nullptr;
+	uint32_t max_frames = 0;
+	FramePeakFn frame_peak = nullptr;
+	ApplyGainFn apply_gain = nullptr;
+
+	float ceiling = 1.0f;
+	float release_coef = 1.0f; //fraction of the way back to the held gain the gain moves each frame
+
+	//running minimum of the gain each frame needs, over the look-ahead window (values increase front to back):
+	static constexpr uint32_t const HoldSize = 128; //(power of two, more than Lookahead + 1)
+	float hold_gain[HoldSize];
+	uint32_t hold_frame[HoldSize];
+	uint32_t hold_begin = 0, hold_end = 0; //(indices wrap at HoldSize)
+	uint32_t frame = 0; //frames processed (wraps; only differences matter)
+
+	float envelope = 1.0f; //held gain, with the release applied
+	float window[Lookahead]; //last Lookahead values of 'envelope', for the moving average...
+	float window_sum = float(Lookahead); //...and their sum
+	uint32_t window_at = 0;
+	uint32_t quiet_frames = Lookahead; //frames in a row 'envelope' has been exactly 1 (up to Lookahead)
+};
@@ -0,0 +1,15 @@
+#include "game_assets.hpp"
+
+#include "Bundle.hpp"
+#include "data_path.hpp"
+
+#include <stdexcept>
+
+Load< Bundle > game_assets(LoadTagDefault, []() -> Bundle const * {
+	try {
+		return new Bundle(data_path("assets.bundle"));
+	} catch (std::runtime_error &e) {
+		//(the bundle is built, not checked in, so the likeliest problem is that it hasn't been built -- or is stale)
+		throw std::runtime_error(std::string(e.what()) + "\n(assets.bundle is built by jam, along with the game; run jam again to rebuild it.)");
+	}
+}, LoadOnAnyThread, "assets.bundle");
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Load.hpp"
+
+struct Bundle; //from Bundle.hpp
+
+//The game's assets are packed into one bundle (dist/assets.bundle; see Bundle.hpp and pack-bundle),
+// which is mapped once and shared by every mode; loaders read their files from it in place.
+//List it in a Load<>'s 'after' to use it:
+// Load< SpriteAtlas > sprites(LoadTagDefault, []() -> SpriteAtlas const * {
+//     return new SpriteAtlas(*game_assets, "the-planet");
+// }, LoadOnMainThread, "sprites", { &game_assets });
+extern Load< Bundle > game_assets;
@@ -8,11 +8,37 @@
 #include <stdexcept>
 #include <iostream>
 
-void load_opus(std::string const &filename, std::vector< float > *data_) {
+//helper: decode all of an opened file:
+static void decode_all(OggOpusFile *op, std::string const &filename, std::vector< float > *data_, uint32_t *channels_) {
 	assert(data_);
+	assert(channels_);
 	auto &data = *data_;
 	data.clear();
 
+	uint32_t channels = (op_channel_count(op, -1) == 1 ? 1 : 2);
+	*channels_ = channels;
+
+	//decode straight into 'data', which is sized up front when the length is known:
+	ogg_int64_t total = op_pcm_total(op, -1);
+	if (total > 0) data.reserve(size_t(total) * channels);
+
+	constexpr uint32_t const Chunk = 5760; //largest opus packet (120ms at 48kHz)
+	for (;;) {
+		size_t at = data.size();
+		data.resize(at + Chunk * channels);
+		int ret;
+		if (channels == 1) ret = op_read_float(op, data.data() + at, int(Chunk), nullptr);
+		else ret = op_read_float_stereo(op, data.data() + at, int(Chunk * 2));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		//positive return values are the number of samples read per channel:
+		data.resize(at + size_t(ret) * channels);
+		if (ret == 0) break;
+	}
+}
+
+void load_opus(std::string const &filename, std::vector< float > *data, uint32_t *channels) {
 	std::cout << "loading '" << filename << "'..."; std::cout.flush();
 
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
@@ -24,21 +50,70 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 	if (err != 0) {
 		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
 	}
+	decode_all(op.get(), filename, data, channels);
 
-	for (;;) {
-		std::vector< float > pcm(2*48000*2, 0.0f);
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
-		}
+	std::cout << " done." << std::endl;
+}
+
+void load_opus(std::string const &name, unsigned char const *bytes, size_t size, std::vector< float > *data, uint32_t *channels) {
+	std::cout << "loading '" << name << "' from memory..."; std::cout.flush();
+
+	int err = 0;
+	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
+		op_open_memory(bytes, size, &err),
+		op_free
+	);
+	if (err != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + name + "\" from memory.");
 	}
+	decode_all(op.get(), name, data, channels);
 
 	std::cout << " done." << std::endl;
 }
+
+
+OpusStream::OpusStream(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" for streaming.");
+	}
+	channels = (op_channel_count(op, -1) == 1 ? 1 : 2);
+}
+
+OpusStream::OpusStream(std::string const &filename_, unsigned char const *data, size_t size) : filename(filename_) {
+	int err = 0;
+	op = op_open_memory(data, size, &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" from memory.");
+	}
+	channels = (op_channel_count(op, -1) == 1 ? 1 : 2);
+}
+
+OpusStream::~OpusStream() {
+	if (op) op_free(op);
+	op = nullptr;
+}
+
+uint32_t OpusStream::read(float *out, uint32_t count) {
+	int ret;
+	if (channels == 1) ret = op_read_float(op, out, int(count), nullptr);
+	else ret = op_read_float_stereo(op, out, int(2 * count));
+	if (ret < 0) {
+		throw std::runtime_error("opusfile read error " + std::to_string(ret) + " streaming \"" + filename + "\".");
+	}
+	assert(uint32_t(ret) <= count);
+	return uint32_t(ret);
+}
+
+void OpusStream::seek(uint64_t frame) {
+	int ret = op_pcm_seek(op, ogg_int64_t(frame));
+	if (ret != 0) {
+		throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " streaming \"" + filename + "\".");
+	}
+}
+
+uint64_t OpusStream::length() const {
+	ogg_int64_t total = op_pcm_total(op, -1);
+	return (total < 0 ? 0 : uint64_t(total));
+}
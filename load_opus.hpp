@@ -2,6 +2,37 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
-//Load an opus file as 48kHz floating-point mono; throws on error:
-void load_opus(std::string const &filename, std::vector< float > *data);
+//Load an opus file as 48kHz floating-point mono or interleaved stereo; throws on error:
+// (mono files stay mono; anything with more channels is downmixed to stereo by the decoder)
+void load_opus(std::string const &filename, std::vector< float > *data, uint32_t *channels);
+//...or from a file that is already in memory ('name' is just for messages):
+void load_opus(std::string const &name, unsigned char const *bytes, size_t size, std::vector< float > *data, uint32_t *channels);
+
+//Decode an opus file a little at a time (used for streamed Sound::Samples):
+typedef struct OggOpusFile OggOpusFile;
+struct OpusStream {
+	//opens the file; throws on error:
+	OpusStream(std::string const &filename);
+	//decodes from an in-memory copy of a file ('data' must stay around as long as the stream); throws on error:
+	OpusStream(std::string const &filename, unsigned char const *data, size_t size);
+	~OpusStream();
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//decode up to 'count' frames of 48kHz audio (interleaved, 'channels' values per frame) into 'out';
+	// returns number of frames decoded (0 at end of file); throws on error.
+	uint32_t read(float *out, uint32_t count);
+
+	//move decoding position to 'frame' (in 48kHz frames from start of file); throws on error:
+	void seek(uint64_t frame);
+
+	//total length of the file, in frames:
+	uint64_t length() const;
+
+	std::string filename; //for error messages
+	OggOpusFile *op = nullptr;
+	uint32_t channels = 2; //1 or 2
+};
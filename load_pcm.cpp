@@ -0,0 +1,87 @@
+#include "load_pcm.hpp"
+#include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+
+//helper: complain about anything odd in a .pcm file's info:
+static void check_info(std::string const &filename, PCMInfo const &info, size_t values) {
+	if (info.channels != 1 && info.channels != 2) {
+		throw std::runtime_error("PCM file '" + filename + "' has " + std::to_string(info.channels) + " channels (expecting 1 or 2).");
+	}
+	if (info.rate == 0) {
+		throw std::runtime_error("PCM file '" + filename + "' has a sampling rate of zero.");
+	}
+	if (info.frames == 0) {
+		throw std::runtime_error("PCM file '" + filename + "' is empty.");
+	}
+	if (values != size_t(info.frames) * info.channels) {
+		throw std::runtime_error("PCM file '" + filename + "' should have " + std::to_string(info.frames) + " frames of audio, but has " + std::to_string(values / info.channels) + ".");
+	}
+}
+
+void save_pcm(std::string const &filename, std::vector< float > const &data, uint32_t channels, uint32_t rate) {
+	if (channels != 1 && channels != 2) {
+		throw std::runtime_error("Can't save " + std::to_string(channels) + "-channel audio to '" + filename + "'.");
+	}
+	std::vector< PCMInfo > info(1);
+	info[0].channels = channels;
+	info[0].rate = rate;
+	info[0].frames = uint32_t(data.size() / channels);
+	check_info(filename, info[0], data.size());
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+	write_chunk("pcm0", info, &out);
+	write_chunk("f32 ", data, &out);
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + filename + "'.");
+	}
+}
+
+void load_pcm(std::string const &filename, std::vector< float > *data, uint32_t *channels, uint32_t *rate) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	std::vector< PCMInfo > info;
+	read_chunk(in, "pcm0", &info);
+	if (info.size() != 1) {
+		throw std::runtime_error("PCM file '" + filename + "' should have exactly one info entry.");
+	}
+	read_chunk(in, "f32 ", data);
+	check_info(filename, info[0], data->size());
+	*channels = info[0].channels;
+	*rate = info[0].rate;
+}
+
+//helper: check the headers of a .pcm file that is already in memory; returns where the samples start:
+static float const *find_samples(std::string const &filename, unsigned char const *bytes, size_t size, PCMInfo *info) {
+	ChunkReader reader(bytes, size, filename);
+	ChunkView< PCMInfo > infos = reader.view< PCMInfo >("pcm0");
+	if (infos.size != 1) {
+		throw std::runtime_error("PCM file '" + filename + "' should have exactly one info entry.");
+	}
+	*info = infos[0];
+	//(view<> throws if the samples aren't aligned -- bake-pcm lays them out so they are)
+	ChunkView< float > samples = reader.view< float >("f32 ");
+	check_info(filename, *info, samples.size);
+	return samples.data;
+}
+
+MappedPCM::MappedPCM(std::string const &filename_) : filename(filename_) {
+	file.reset(new MappedFile(filename));
+	data = find_samples(filename, file->data, file->size, &info);
+}
+
+MappedPCM::MappedPCM(std::string const &name, unsigned char const *bytes, size_t size) : filename(name) {
+	data = find_samples(filename, bytes, size, &info);
+}
+
+MappedPCM::~MappedPCM() {
+	//(out of line, where MappedFile is a complete type)
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+struct MappedFile;
+
+//Raw floating-point audio, baked from .wav or .opus files ahead of time by the bake-pcm tool.
+//A '.pcm' file is two chunks in the read_write_chunk.hpp format:
+//  "pcm0" -- one PCMInfo
+//  "f32 " -- the samples (interleaved, for stereo), 'frames' * 'channels' floats
+//so the samples start 32 bytes into the file, which keeps them aligned for the mixer when the file is memory-mapped.
+struct PCMInfo {
+	uint32_t channels = 1; //1 or 2
+	uint32_t rate = 48000; //frames per second (bake-pcm always writes 48kHz, so the mixer doesn't need to resample)
+	uint32_t frames = 0;
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(PCMInfo) == 16, "PCMInfo is packed");
+
+//Save floating-point mono or interleaved stereo as a .pcm file; throws on error:
+void save_pcm(std::string const &filename, std::vector< float > const &data, uint32_t channels, uint32_t rate);
+
+//Load (copy) a .pcm file; throws on error:
+void load_pcm(std::string const &filename, std::vector< float > *data, uint32_t *channels, uint32_t *rate);
+
+//Memory-map a .pcm file, read-only (used for Mapped Sound::Samples):
+// nothing is read or copied up front -- the OS pages the audio in as it is first touched,
+// and (since the pages are backed by the file) can drop them again under memory pressure.
+struct MappedPCM {
+	//maps the file and checks its header; throws on error:
+	MappedPCM(std::string const &filename);
+	//uses a .pcm file that is already in memory (e.g., in a mapped Bundle) -- 'bytes' must stay around
+	// as long as this does; checks the header; throws on error:
+	MappedPCM(std::string const &name, unsigned char const *bytes, size_t size);
+	~MappedPCM();
+	MappedPCM(MappedPCM const &) = delete;
+	MappedPCM &operator=(MappedPCM const &) = delete;
+
+	std::string filename; //for error messages
+	PCMInfo info;
+	float const *data = nullptr; //info.frames * info.channels samples, inside the file's bytes
+
+	std::unique_ptr< MappedFile > file; //(if this mapped the file itself)
+};
@@ -26,6 +26,14 @@ void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 >
 	}
 }
 
+void load_png(std::istream &from, std::string const &name, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
+	assert(size);
+
+	if (!load_png(from, &size->x, &size->y, data, origin)) {
+		throw std::runtime_error("Failed to read PNG image from '" + name + "'.");
+	}
+}
+
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin) {
 	std::ofstream file(filename.c_str(), std::ios::binary);
 	save_png(file, size.x, size.y, data, origin);
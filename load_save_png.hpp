@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <iosfwd>
 #include <vector>
 #include <stdint.h>
 
@@ -17,4 +18,6 @@ enum OriginLocation {
 
 //NOTE: load_png will throw on error
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
+//...or from a stream that is already open ('name' is just for messages):
+void load_png(std::istream &from, std::string const &name, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin);
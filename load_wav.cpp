@@ -3,13 +3,17 @@
 #include <SDL.h>
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
-void load_wav(std::string const &filename, std::vector< float > *data_) {
+void load_wav(std::string const &filename, std::vector< float > *data_, uint32_t *channels_, uint32_t *rate_) {
 	assert(data_);
+	assert(channels_);
+	assert(rate_);
 	auto &data = *data_;
 
 	SDL_AudioSpec audio_spec;
@@ -22,10 +26,14 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
+	//(the sampling rate is left alone -- the mixer resamples as it plays, which is cheaper than storing a bigger copy)
+	uint32_t channels = (have->channels == 1 ? 1 : 2);
+	*channels_ = channels;
+	*rate_ = uint32_t(have->freq);
 	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
+	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, Uint8(channels), have->freq);
 	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as float32 " + (channels == 1 ? "mono" : "stereo") + "; converting." << std::endl;
 		cvt.len = audio_len;
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
@@ -48,3 +56,48 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 	std::cout << "Range: " << min << ", " << max << std::endl;
 }
+
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels) {
+	assert(channels == 1 || channels == 2);
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+
+	//WAV files are little-endian:
+	auto write_u32 = [&file](uint32_t v) {
+		char bytes[4] = { char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char((v >> 24) & 0xff) };
+		file.write(bytes, 4);
+	};
+	auto write_u16 = [&file](uint16_t v) {
+		char bytes[2] = { char(v & 0xff), char((v >> 8) & 0xff) };
+		file.write(bytes, 2);
+	};
+
+	uint32_t data_bytes = uint32_t(data.size() * sizeof(float));
+	file.write("RIFF", 4);
+	write_u32(4 + (8 + 16) + (8 + data_bytes));
+	file.write("WAVE", 4);
+
+	file.write("fmt ", 4);
+	write_u32(16);
+	write_u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	write_u16(uint16_t(channels));
+	write_u32(AUDIO_RATE);
+	write_u32(AUDIO_RATE * channels * sizeof(float)); //bytes per second
+	write_u16(uint16_t(channels * sizeof(float))); //bytes per frame
+	write_u16(32); //bits per sample
+
+	file.write("data", 4);
+	write_u32(data_bytes);
+	for (float f : data) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		write_u32(bits);
+	}
+
+	if (!file) {
+		throw std::runtime_error("Failed to write '" + filename + "'.");
+	}
+}
@@ -2,6 +2,11 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
-//Load a WAV file as 48kHz floating-point mono; throws on error:
-void load_wav(std::string const &filename, std::vector< float > *data);
+//Load a WAV file as floating-point mono or interleaved stereo, at the file's own sampling rate; throws on error:
+// (files with more than two channels are downmixed to stereo)
+void load_wav(std::string const &filename, std::vector< float > *data, uint32_t *channels, uint32_t *rate);
+
+//Save 48kHz floating-point mono or interleaved stereo as a (32-bit float) WAV file; throws on error:
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels);
@@ -26,6 +26,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <cstdlib>
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -91,7 +92,13 @@ int main(int argc, char **argv) {
 	}
 
 	//set up sound output:
-	Sound::init();
+	// (flap sounds should follow clicks closely, so mix in small blocks; this is set once, here,
+	//  since changing it later reopens the audio device and leaves an audible gap)
+	Sound::init(64, 256);
+	//(run with SOUND_STATS=some-file.txt to get mixer timing and voice counts when the game exits)
+	if (char const *stats_file = std::getenv("SOUND_STATS")) {
+		Sound::set_stats_file(stats_file);
+	}
 
 	//Hide mouse cursor (note: showing can be useful for debugging):
 	//SDL_ShowCursor(SDL_DISABLE);
@@ -168,6 +175,9 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			//let the audio system adjust to how its callback is keeping up:
+			Sound::update();
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
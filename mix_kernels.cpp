@@ -0,0 +1,655 @@
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//SIMD kernels are only built for 64-bit x86, where SSE2 is always available:
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIX_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//GCC and clang need to be told a function may use AVX2 instructions; MSVC doesn't care:
+#if defined(__GNUC__)
+#define MIX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MIX_TARGET_AVX2
+#endif
+
+//shared by all kernels: mix frames [begin,end) exactly as described in mix_kernels.hpp:
+static inline void mix_mono_range(float const *in, float *out, uint32_t begin, uint32_t end, float gain_l, float gain_r, float step_l, float step_r) {
+	for (uint32_t k = begin; k < end; ++k) {
+		float l = gain_l + float(k) * step_l;
+		float r = gain_r + float(k) * step_r;
+		out[2*k+0] += l * in[k];
+		out[2*k+1] += r * in[k];
+	}
+}
+
+static inline void mix_stereo_range(float const *in, float *out, uint32_t begin, uint32_t end, float gain_l, float gain_r, float step_l, float step_r) {
+	for (uint32_t k = begin; k < end; ++k) {
+		float l = gain_l + float(k) * step_l;
+		float r = gain_r + float(k) * step_r;
+		out[2*k+0] += l * in[2*k+0];
+		out[2*k+1] += r * in[2*k+1];
+	}
+}
+
+//sin() for the tone kernels: reduce to [-pi,pi] (rounding with the 1.5 * 2^23 trick, which matches
+// round-to-nearest in the SIMD versions), fold into [-pi/2,pi/2], then a Taylor polynomial to x^11:
+// (valid for |x| up to about 2^22 radians)
+static float const TONE_ROUND = 12582912.0f;
+static float const TONE_INV_TWO_PI = 0.159154943f;
+static float const TONE_TWO_PI_HI = 6.28125f; //(2 pi split in two, so k * 2 pi can be subtracted accurately)
+static float const TONE_TWO_PI_LO = 0.00193530717f;
+static float const TONE_PI = 3.14159265f;
+static float const TONE_HALF_PI = 1.57079633f;
+static float const TONE_C3 = -1.0f / 6.0f;
+static float const TONE_C5 = 1.0f / 120.0f;
+static float const TONE_C7 = -1.0f / 5040.0f;
+static float const TONE_C9 = 1.0f / 362880.0f;
+static float const TONE_C11 = -1.0f / 39916800.0f;
+
+static inline float tone_sin(float x) {
+	float k = (x * TONE_INV_TWO_PI + TONE_ROUND) - TONE_ROUND;
+	float r = (x - k * TONE_TWO_PI_HI) - k * TONE_TWO_PI_LO;
+	r = (r > TONE_HALF_PI ? TONE_PI - r : r);
+	r = (r < -TONE_HALF_PI ? -TONE_PI - r : r);
+	float r2 = r * r;
+	return r + r * (r2 * (TONE_C3 + r2 * (TONE_C5 + r2 * (TONE_C7 + r2 * (TONE_C9 + r2 * TONE_C11)))));
+}
+
+static inline void synth_tone_range(float *out, uint32_t first, uint32_t begin, uint32_t end, float carrier, float modulator, float index, float decay, float amplitude, uint32_t falloff) {
+	for (uint32_t k = begin; k < end; ++k) {
+		float x = float(first + k);
+		float e = std::max(0.0f, 1.0f - x * decay);
+		float env = amplitude;
+		for (uint32_t f = 0; f < falloff; ++f) env *= e;
+		out[k] = env * tone_sin(carrier * x + index * tone_sin(modulator * x));
+	}
+}
+
+static void synth_tone_scalar(float *out, uint32_t first, uint32_t count, float carrier, float modulator, float index, float decay, float amplitude, uint32_t falloff) {
+	synth_tone_range(out, first, 0, count, carrier, modulator, index, decay, amplitude, falloff);
+}
+
+//resampling helpers: where in the source output frames come from, and the interpolated coefficients there:
+static inline void resample_coefficients(float const *table, uint64_t pos, float *c) {
+	uint32_t frac = uint32_t(pos);
+	float const *row0 = table + RESAMPLE_TAPS * (frac >> 24);
+	float const *row1 = row0 + RESAMPLE_TAPS;
+	float f = float(frac & 0xffffff) * (1.0f / 16777216.0f);
+	for (uint32_t t = 0; t < RESAMPLE_TAPS; ++t) {
+		c[t] = row0[t] + f * (row1[t] - row0[t]);
+	}
+}
+
+static inline void resample_mono_range(float const *in, float *out, uint32_t begin, uint32_t end, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = begin; k < end; ++k) {
+		uint64_t pos = position + k * step;
+		float c[RESAMPLE_TAPS];
+		resample_coefficients(table, pos, c);
+		float const *x = in + (pos >> 32) - RESAMPLE_BEFORE;
+		float p[8], q[4];
+		for (uint32_t j = 0; j < 8; ++j) p[j] = x[j] * c[j] + x[j+8] * c[j+8];
+		for (uint32_t j = 0; j < 4; ++j) q[j] = p[j] + p[j+4];
+		out[k] = (q[0] + q[2]) + (q[1] + q[3]);
+	}
+}
+
+static inline void resample_stereo_range(float const *in, float *out, uint32_t begin, uint32_t end, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = begin; k < end; ++k) {
+		uint64_t pos = position + k * step;
+		float c[RESAMPLE_TAPS];
+		resample_coefficients(table, pos, c);
+		float const *x = in + 2 * ((pos >> 32) - RESAMPLE_BEFORE);
+		//(values alternate left/right, so the coefficient for x[i] is c[i/2])
+		float p[8], q[4];
+		for (uint32_t j = 0; j < 8; ++j) {
+			p[j] = ((x[j] * c[j/2] + x[j+8] * c[(j+8)/2]) + x[j+16] * c[(j+16)/2]) + x[j+24] * c[(j+24)/2];
+		}
+		for (uint32_t j = 0; j < 4; ++j) q[j] = p[j] + p[j+4];
+		out[2*k+0] = q[0] + q[2];
+		out[2*k+1] = q[1] + q[3];
+	}
+}
+
+static void resample_mono_scalar(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	resample_mono_range(in, out, 0, count, position, step, table);
+}
+
+static void resample_stereo_scalar(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	resample_stereo_range(in, out, 0, count, position, step, table);
+}
+
+//shared by the limiter kernels: frames [begin,end), with max/min spelled the way the SIMD instructions do them:
+static inline float frame_peak_range(float const *in, float *peak, uint32_t begin, uint32_t end, float largest) {
+	for (uint32_t k = begin; k < end; ++k) {
+		float l = std::abs(in[2*k+0]);
+		float r = std::abs(in[2*k+1]);
+		float p = (l > r ? l : r);
+		peak[k] = p;
+		largest = (largest > p ? largest : p);
+	}
+	return largest;
+}
+
+static inline void apply_gain_range(float const *in, float const *gain, float *out, uint32_t begin, uint32_t end, float ceiling) {
+	for (uint32_t k = begin; k < end; ++k) {
+		for (uint32_t c = 0; c < 2; ++c) {
+			float x = gain[k] * in[2*k+c];
+			x = (x > -ceiling ? x : -ceiling);
+			out[2*k+c] = (x < ceiling ? x : ceiling);
+		}
+	}
+}
+
+static float frame_peak_scalar(float const *in, float *peak, uint32_t count) {
+	return frame_peak_range(in, peak, 0, count, 0.0f);
+}
+
+static void apply_gain_scalar(float const *in, float const *gain, float *out, uint32_t count, float ceiling) {
+	apply_gain_range(in, gain, out, 0, count, ceiling);
+}
+
+static void mix_mono_scalar(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	mix_mono_range(in, out, 0, count, gain_l, gain_r, step_l, step_r);
+}
+
+static void mix_stereo_scalar(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	mix_stereo_range(in, out, 0, count, gain_l, gain_r, step_l, step_r);
+}
+
+#ifdef MIX_KERNELS_X86
+
+static void mix_mono_sse2(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	__m128 const gl = _mm_set1_ps(gain_l);
+	__m128 const gr = _mm_set1_ps(gain_r);
+	__m128 const sl = _mm_set1_ps(step_l);
+	__m128 const sr = _mm_set1_ps(step_r);
+	__m128 const four = _mm_set1_ps(4.0f);
+	__m128 kf = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); //frame indices (exact as floats up to 2^24)
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 x = _mm_loadu_ps(in + k);
+		__m128 l = _mm_mul_ps(_mm_add_ps(gl, _mm_mul_ps(kf, sl)), x);
+		__m128 r = _mm_mul_ps(_mm_add_ps(gr, _mm_mul_ps(kf, sr)), x);
+		//interleave to l0 r0 l1 r1 | l2 r2 l3 r3:
+		__m128 o0 = _mm_add_ps(_mm_loadu_ps(out + 2*k + 0), _mm_unpacklo_ps(l, r));
+		__m128 o1 = _mm_add_ps(_mm_loadu_ps(out + 2*k + 4), _mm_unpackhi_ps(l, r));
+		_mm_storeu_ps(out + 2*k + 0, o0);
+		_mm_storeu_ps(out + 2*k + 4, o1);
+		kf = _mm_add_ps(kf, four);
+	}
+	//end-of-block (or end-of-sample) tail:
+	mix_mono_range(in, out, k, count, gain_l, gain_r, step_l, step_r);
+}
+
+MIX_TARGET_AVX2
+static void mix_mono_avx2(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	__m256 const gl = _mm256_set1_ps(gain_l);
+	__m256 const gr = _mm256_set1_ps(gain_r);
+	__m256 const sl = _mm256_set1_ps(step_l);
+	__m256 const sr = _mm256_set1_ps(step_r);
+	__m256 const eight = _mm256_set1_ps(8.0f);
+	__m256 kf = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 x = _mm256_loadu_ps(in + k);
+		__m256 l = _mm256_mul_ps(_mm256_add_ps(gl, _mm256_mul_ps(kf, sl)), x);
+		__m256 r = _mm256_mul_ps(_mm256_add_ps(gr, _mm256_mul_ps(kf, sr)), x);
+		//unpack works within 128-bit lanes: lo = l0 r0 l1 r1 | l4 r4 l5 r5, hi = l2 r2 l3 r3 | l6 r6 l7 r7
+		__m256 lo = _mm256_unpacklo_ps(l, r);
+		__m256 hi = _mm256_unpackhi_ps(l, r);
+		//...so swap halves around to get frames 0-3 and 4-7:
+		__m256 f0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+		__m256 f1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+		_mm256_storeu_ps(out + 2*k + 0, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 0), f0));
+		_mm256_storeu_ps(out + 2*k + 8, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 8), f1));
+		kf = _mm256_add_ps(kf, eight);
+	}
+	mix_mono_range(in, out, k, count, gain_l, gain_r, step_l, step_r);
+}
+
+static void mix_stereo_sse2(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	//two frames per vector: gains are l r l r, frame indices are k k k+1 k+1:
+	__m128 const g = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+	__m128 const st = _mm_setr_ps(step_l, step_r, step_l, step_r);
+	__m128 const two = _mm_set1_ps(2.0f);
+	__m128 kf = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+
+	uint32_t k = 0;
+	for (; k + 2 <= count; k += 2) {
+		__m128 x = _mm_loadu_ps(in + 2*k);
+		__m128 o = _mm_add_ps(_mm_loadu_ps(out + 2*k), _mm_mul_ps(_mm_add_ps(g, _mm_mul_ps(kf, st)), x));
+		_mm_storeu_ps(out + 2*k, o);
+		kf = _mm_add_ps(kf, two);
+	}
+	mix_stereo_range(in, out, k, count, gain_l, gain_r, step_l, step_r);
+}
+
+MIX_TARGET_AVX2
+static void mix_stereo_avx2(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r) {
+	//four frames per vector:
+	__m256 const g = _mm256_setr_ps(gain_l, gain_r, gain_l, gain_r, gain_l, gain_r, gain_l, gain_r);
+	__m256 const st = _mm256_setr_ps(step_l, step_r, step_l, step_r, step_l, step_r, step_l, step_r);
+	__m256 const four = _mm256_set1_ps(4.0f);
+	__m256 kf = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m256 x = _mm256_loadu_ps(in + 2*k);
+		__m256 o = _mm256_add_ps(_mm256_loadu_ps(out + 2*k), _mm256_mul_ps(_mm256_add_ps(g, _mm256_mul_ps(kf, st)), x));
+		_mm256_storeu_ps(out + 2*k, o);
+		kf = _mm256_add_ps(kf, four);
+	}
+	mix_stereo_range(in, out, k, count, gain_l, gain_r, step_l, step_r);
+}
+
+static inline __m128 tone_sin_sse2(__m128 x) {
+	__m128 const round = _mm_set1_ps(TONE_ROUND);
+	__m128 const half_pi = _mm_set1_ps(TONE_HALF_PI);
+	__m128 const neg_half_pi = _mm_set1_ps(-TONE_HALF_PI);
+	__m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(TONE_INV_TWO_PI)), round), round);
+	__m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(TONE_TWO_PI_HI))), _mm_mul_ps(k, _mm_set1_ps(TONE_TWO_PI_LO)));
+	//fold (select with and/andnot/or, since SSE2 has no blend):
+	__m128 above = _mm_cmpgt_ps(r, half_pi);
+	r = _mm_or_ps(_mm_and_ps(above, _mm_sub_ps(_mm_set1_ps(TONE_PI), r)), _mm_andnot_ps(above, r));
+	__m128 below = _mm_cmplt_ps(r, neg_half_pi);
+	r = _mm_or_ps(_mm_and_ps(below, _mm_sub_ps(_mm_set1_ps(-TONE_PI), r)), _mm_andnot_ps(below, r));
+	__m128 r2 = _mm_mul_ps(r, r);
+	__m128 p = _mm_add_ps(_mm_set1_ps(TONE_C9), _mm_mul_ps(r2, _mm_set1_ps(TONE_C11)));
+	p = _mm_add_ps(_mm_set1_ps(TONE_C7), _mm_mul_ps(r2, p));
+	p = _mm_add_ps(_mm_set1_ps(TONE_C5), _mm_mul_ps(r2, p));
+	p = _mm_add_ps(_mm_set1_ps(TONE_C3), _mm_mul_ps(r2, p));
+	return _mm_add_ps(r, _mm_mul_ps(r, _mm_mul_ps(r2, p)));
+}
+
+static void synth_tone_sse2(float *out, uint32_t first, uint32_t count, float carrier, float modulator, float index, float decay, float amplitude, uint32_t falloff) {
+	__m128 const c = _mm_set1_ps(carrier);
+	__m128 const m = _mm_set1_ps(modulator);
+	__m128 const i = _mm_set1_ps(index);
+	__m128 const d = _mm_set1_ps(decay);
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const zero = _mm_setzero_ps();
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		//(frame numbers are converted as integers, so they round exactly as float(first + k) does)
+		__m128 x = _mm_cvtepi32_ps(_mm_setr_epi32(int32_t(first + k), int32_t(first + k + 1), int32_t(first + k + 2), int32_t(first + k + 3)));
+		__m128 e = _mm_max_ps(zero, _mm_sub_ps(one, _mm_mul_ps(x, d)));
+		__m128 env = _mm_set1_ps(amplitude);
+		for (uint32_t f = 0; f < falloff; ++f) env = _mm_mul_ps(env, e);
+		__m128 s = tone_sin_sse2(_mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(i, tone_sin_sse2(_mm_mul_ps(m, x)))));
+		_mm_storeu_ps(out + k, _mm_mul_ps(env, s));
+	}
+	synth_tone_range(out, first, k, count, carrier, modulator, index, decay, amplitude, falloff);
+}
+
+MIX_TARGET_AVX2
+static inline __m256 tone_sin_avx2(__m256 x) {
+	__m256 const round = _mm256_set1_ps(TONE_ROUND);
+	__m256 k = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(TONE_INV_TWO_PI)), round), round);
+	__m256 r = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(k, _mm256_set1_ps(TONE_TWO_PI_HI))), _mm256_mul_ps(k, _mm256_set1_ps(TONE_TWO_PI_LO)));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(TONE_PI), r), _mm256_cmp_ps(r, _mm256_set1_ps(TONE_HALF_PI), _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(-TONE_PI), r), _mm256_cmp_ps(r, _mm256_set1_ps(-TONE_HALF_PI), _CMP_LT_OQ));
+	__m256 r2 = _mm256_mul_ps(r, r);
+	__m256 p = _mm256_add_ps(_mm256_set1_ps(TONE_C9), _mm256_mul_ps(r2, _mm256_set1_ps(TONE_C11)));
+	p = _mm256_add_ps(_mm256_set1_ps(TONE_C7), _mm256_mul_ps(r2, p));
+	p = _mm256_add_ps(_mm256_set1_ps(TONE_C5), _mm256_mul_ps(r2, p));
+	p = _mm256_add_ps(_mm256_set1_ps(TONE_C3), _mm256_mul_ps(r2, p));
+	return _mm256_add_ps(r, _mm256_mul_ps(r, _mm256_mul_ps(r2, p)));
+}
+
+MIX_TARGET_AVX2
+static void synth_tone_avx2(float *out, uint32_t first, uint32_t count, float carrier, float modulator, float index, float decay, float amplitude, uint32_t falloff) {
+	__m256 const c = _mm256_set1_ps(carrier);
+	__m256 const m = _mm256_set1_ps(modulator);
+	__m256 const i = _mm256_set1_ps(index);
+	__m256 const d = _mm256_set1_ps(decay);
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const zero = _mm256_setzero_ps();
+	__m256i const steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(int32_t(first + k)), steps));
+		__m256 e = _mm256_max_ps(zero, _mm256_sub_ps(one, _mm256_mul_ps(x, d)));
+		__m256 env = _mm256_set1_ps(amplitude);
+		for (uint32_t f = 0; f < falloff; ++f) env = _mm256_mul_ps(env, e);
+		__m256 s = tone_sin_avx2(_mm256_add_ps(_mm256_mul_ps(c, x), _mm256_mul_ps(i, tone_sin_avx2(_mm256_mul_ps(m, x)))));
+		_mm256_storeu_ps(out + k, _mm256_mul_ps(env, s));
+	}
+	synth_tone_range(out, first, k, count, carrier, modulator, index, decay, amplitude, falloff);
+}
+
+//SIMD resamplers work on one output frame at a time, with the taps spread across the vector lanes:
+static inline __m128 resample_coefficients_sse2(float const *row0, __m128 f, uint32_t t) {
+	__m128 a = _mm_loadu_ps(row0 + t);
+	__m128 b = _mm_loadu_ps(row0 + RESAMPLE_TAPS + t);
+	return _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a)));
+}
+
+static void resample_mono_sse2(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = 0; k < count; ++k) {
+		uint64_t pos = position + k * step;
+		uint32_t frac = uint32_t(pos);
+		float const *row0 = table + RESAMPLE_TAPS * (frac >> 24);
+		__m128 f = _mm_set1_ps(float(frac & 0xffffff) * (1.0f / 16777216.0f));
+		float const *x = in + (pos >> 32) - RESAMPLE_BEFORE;
+		//p = taps 0-3 + taps 8-11 and taps 4-7 + taps 12-15, so q = p_lo + p_hi:
+		__m128 p_lo = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + 0), resample_coefficients_sse2(row0, f, 0)), _mm_mul_ps(_mm_loadu_ps(x + 8), resample_coefficients_sse2(row0, f, 8)));
+		__m128 p_hi = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(x + 4), resample_coefficients_sse2(row0, f, 4)), _mm_mul_ps(_mm_loadu_ps(x + 12), resample_coefficients_sse2(row0, f, 12)));
+		__m128 q = _mm_add_ps(p_lo, p_hi);
+		__m128 r = _mm_add_ps(q, _mm_movehl_ps(q, q)); //q0+q2, q1+q3
+		_mm_store_ss(out + k, _mm_add_ss(r, _mm_shuffle_ps(r, r, 1)));
+	}
+}
+
+static void resample_stereo_sse2(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = 0; k < count; ++k) {
+		uint64_t pos = position + k * step;
+		uint32_t frac = uint32_t(pos);
+		float const *row0 = table + RESAMPLE_TAPS * (frac >> 24);
+		__m128 f = _mm_set1_ps(float(frac & 0xffffff) * (1.0f / 16777216.0f));
+		float const *x = in + 2 * ((pos >> 32) - RESAMPLE_BEFORE);
+		//coefficients, each doubled up to line up with left/right pairs:
+		__m128 cc[8];
+		for (uint32_t m = 0; m < 4; ++m) {
+			__m128 c = resample_coefficients_sse2(row0, f, 4 * m);
+			cc[2*m+0] = _mm_unpacklo_ps(c, c);
+			cc[2*m+1] = _mm_unpackhi_ps(c, c);
+		}
+		__m128 p_lo = _mm_mul_ps(_mm_loadu_ps(x + 0), cc[0]);
+		p_lo = _mm_add_ps(p_lo, _mm_mul_ps(_mm_loadu_ps(x + 8), cc[2]));
+		p_lo = _mm_add_ps(p_lo, _mm_mul_ps(_mm_loadu_ps(x + 16), cc[4]));
+		p_lo = _mm_add_ps(p_lo, _mm_mul_ps(_mm_loadu_ps(x + 24), cc[6]));
+		__m128 p_hi = _mm_mul_ps(_mm_loadu_ps(x + 4), cc[1]);
+		p_hi = _mm_add_ps(p_hi, _mm_mul_ps(_mm_loadu_ps(x + 12), cc[3]));
+		p_hi = _mm_add_ps(p_hi, _mm_mul_ps(_mm_loadu_ps(x + 20), cc[5]));
+		p_hi = _mm_add_ps(p_hi, _mm_mul_ps(_mm_loadu_ps(x + 28), cc[7]));
+		__m128 q = _mm_add_ps(p_lo, p_hi);
+		_mm_storel_pi(reinterpret_cast< __m64 * >(out + 2*k), _mm_add_ps(q, _mm_movehl_ps(q, q)));
+	}
+}
+
+MIX_TARGET_AVX2
+static inline __m256 resample_coefficients_avx2(float const *row0, __m256 f, uint32_t t) {
+	__m256 a = _mm256_loadu_ps(row0 + t);
+	__m256 b = _mm256_loadu_ps(row0 + RESAMPLE_TAPS + t);
+	return _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(b, a)));
+}
+
+MIX_TARGET_AVX2
+static void resample_mono_avx2(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = 0; k < count; ++k) {
+		uint64_t pos = position + k * step;
+		uint32_t frac = uint32_t(pos);
+		float const *row0 = table + RESAMPLE_TAPS * (frac >> 24);
+		__m256 f = _mm256_set1_ps(float(frac & 0xffffff) * (1.0f / 16777216.0f));
+		float const *x = in + (pos >> 32) - RESAMPLE_BEFORE;
+		__m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(x + 0), resample_coefficients_avx2(row0, f, 0)), _mm256_mul_ps(_mm256_loadu_ps(x + 8), resample_coefficients_avx2(row0, f, 8)));
+		__m128 q = _mm_add_ps(_mm256_castps256_ps128(p), _mm256_extractf128_ps(p, 1));
+		__m128 r = _mm_add_ps(q, _mm_movehl_ps(q, q));
+		_mm_store_ss(out + k, _mm_add_ss(r, _mm_shuffle_ps(r, r, 1)));
+	}
+}
+
+MIX_TARGET_AVX2
+static void resample_stereo_avx2(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table) {
+	for (uint32_t k = 0; k < count; ++k) {
+		uint64_t pos = position + k * step;
+		uint32_t frac = uint32_t(pos);
+		float const *row0 = table + RESAMPLE_TAPS * (frac >> 24);
+		__m256 f = _mm256_set1_ps(float(frac & 0xffffff) * (1.0f / 16777216.0f));
+		float const *x = in + 2 * ((pos >> 32) - RESAMPLE_BEFORE);
+		//coefficients, each doubled up to line up with left/right pairs (same shuffle as mix_mono_avx2):
+		__m256 cc[4];
+		for (uint32_t m = 0; m < 2; ++m) {
+			__m256 c = resample_coefficients_avx2(row0, f, 8 * m);
+			__m256 lo = _mm256_unpacklo_ps(c, c);
+			__m256 hi = _mm256_unpackhi_ps(c, c);
+			cc[2*m+0] = _mm256_permute2f128_ps(lo, hi, 0x20);
+			cc[2*m+1] = _mm256_permute2f128_ps(lo, hi, 0x31);
+		}
+		__m256 p = _mm256_mul_ps(_mm256_loadu_ps(x + 0), cc[0]);
+		p = _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(x + 8), cc[1]));
+		p = _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(x + 16), cc[2]));
+		p = _mm256_add_ps(p, _mm256_mul_ps(_mm256_loadu_ps(x + 24), cc[3]));
+		__m128 q = _mm_add_ps(_mm256_castps256_ps128(p), _mm256_extractf128_ps(p, 1));
+		_mm_storel_pi(reinterpret_cast< __m64 * >(out + 2*k), _mm_add_ps(q, _mm_movehl_ps(q, q)));
+	}
+}
+
+static float frame_peak_sse2(float const *in, float *peak, uint32_t count) {
+	__m128 const sign = _mm_set1_ps(-0.0f);
+	__m128 largest = _mm_setzero_ps();
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 a = _mm_andnot_ps(sign, _mm_loadu_ps(in + 2*k + 0)); //|l0 r0 l1 r1|
+		__m128 b = _mm_andnot_ps(sign, _mm_loadu_ps(in + 2*k + 4)); //|l2 r2 l3 r3|
+		__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 p = _mm_max_ps(l, r);
+		_mm_storeu_ps(peak + k, p);
+		largest = _mm_max_ps(largest, p);
+	}
+	//(max doesn't care what order it's taken in, so the lanes can be combined any which way)
+	largest = _mm_max_ps(largest, _mm_movehl_ps(largest, largest));
+	largest = _mm_max_ss(largest, _mm_shuffle_ps(largest, largest, _MM_SHUFFLE(1, 1, 1, 1)));
+	return frame_peak_range(in, peak, k, count, _mm_cvtss_f32(largest));
+}
+
+MIX_TARGET_AVX2
+static float frame_peak_avx2(float const *in, float *peak, uint32_t count) {
+	__m256 const sign = _mm256_set1_ps(-0.0f);
+	__m256 largest = _mm256_setzero_ps();
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 a = _mm256_andnot_ps(sign, _mm256_loadu_ps(in + 2*k + 0));
+		__m256 b = _mm256_andnot_ps(sign, _mm256_loadu_ps(in + 2*k + 8));
+		//shuffle works within 128-bit lanes, giving frames 0 1 4 5 | 2 3 6 7...
+		__m256 p = _mm256_max_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		//...so put the pairs back in order:
+		p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(peak + k, p);
+		largest = _mm256_max_ps(largest, p);
+	}
+	__m128 q = _mm_max_ps(_mm256_castps256_ps128(largest), _mm256_extractf128_ps(largest, 1));
+	q = _mm_max_ps(q, _mm_movehl_ps(q, q));
+	q = _mm_max_ss(q, _mm_shuffle_ps(q, q, _MM_SHUFFLE(1, 1, 1, 1)));
+	return frame_peak_range(in, peak, k, count, _mm_cvtss_f32(q));
+}
+
+static void apply_gain_sse2(float const *in, float const *gain, float *out, uint32_t count, float ceiling) {
+	__m128 const hi = _mm_set1_ps(ceiling);
+	__m128 const lo = _mm_set1_ps(-ceiling);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 g = _mm_loadu_ps(gain + k);
+		//gains doubled up to line up with left/right pairs:
+		__m128 o0 = _mm_mul_ps(_mm_unpacklo_ps(g, g), _mm_loadu_ps(in + 2*k + 0));
+		__m128 o1 = _mm_mul_ps(_mm_unpackhi_ps(g, g), _mm_loadu_ps(in + 2*k + 4));
+		_mm_storeu_ps(out + 2*k + 0, _mm_min_ps(_mm_max_ps(o0, lo), hi));
+		_mm_storeu_ps(out + 2*k + 4, _mm_min_ps(_mm_max_ps(o1, lo), hi));
+	}
+	apply_gain_range(in, gain, out, k, count, ceiling);
+}
+
+MIX_TARGET_AVX2
+static void apply_gain_avx2(float const *in, float const *gain, float *out, uint32_t count, float ceiling) {
+	__m256 const hi = _mm256_set1_ps(ceiling);
+	__m256 const lo = _mm256_set1_ps(-ceiling);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 g = _mm256_loadu_ps(gain + k);
+		//(same shuffle as mix_mono_avx2)
+		__m256 gl = _mm256_unpacklo_ps(g, g);
+		__m256 gh = _mm256_unpackhi_ps(g, g);
+		__m256 o0 = _mm256_mul_ps(_mm256_permute2f128_ps(gl, gh, 0x20), _mm256_loadu_ps(in + 2*k + 0));
+		__m256 o1 = _mm256_mul_ps(_mm256_permute2f128_ps(gl, gh, 0x31), _mm256_loadu_ps(in + 2*k + 8));
+		_mm256_storeu_ps(out + 2*k + 0, _mm256_min_ps(_mm256_max_ps(o0, lo), hi));
+		_mm256_storeu_ps(out + 2*k + 8, _mm256_min_ps(_mm256_max_ps(o1, lo), hi));
+	}
+	apply_gain_range(in, gain, out, k, count, ceiling);
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	//OS must save/restore the ymm registers:
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif //MIX_KERNELS_X86
+
+MixMonoFn get_mix_mono(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return mix_mono_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return mix_mono_sse2;
+	if (kernel == MixKernelAVX2) {
+		static bool const has_avx2 = cpu_has_avx2();
+		return (has_avx2 ? mix_mono_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+MixStereoFn get_mix_stereo(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return mix_stereo_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return mix_stereo_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? mix_stereo_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+SynthToneFn get_synth_tone(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return synth_tone_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return synth_tone_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? synth_tone_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+ResampleFn get_resample_mono(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return resample_mono_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return resample_mono_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? resample_mono_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+ResampleFn get_resample_stereo(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return resample_stereo_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return resample_stereo_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? resample_stereo_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+FramePeakFn get_frame_peak(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return frame_peak_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return frame_peak_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? frame_peak_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+ApplyGainFn get_apply_gain(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return apply_gain_scalar;
+#ifdef MIX_KERNELS_X86
+	if (kernel == MixKernelSSE2) return apply_gain_sse2;
+	if (kernel == MixKernelAVX2) {
+		return (get_mix_mono(MixKernelAVX2) ? apply_gain_avx2 : nullptr);
+	}
+#endif
+	return nullptr;
+}
+
+float const *get_resample_table(uint64_t step) {
+	//one table per range of steps; each is cut off just below the Nyquist rate for the largest step in its range:
+	static float const max_steps[] = { 1.0f, 1.5f, 2.0f, 3.0f, 4.0f };
+	constexpr uint32_t const Tables = sizeof(max_steps) / sizeof(max_steps[0]);
+	static std::vector< float > const tables = [](){
+		std::vector< float > tables(Tables * (RESAMPLE_PHASES + 1) * RESAMPLE_TAPS);
+		double const pi = 3.14159265358979323846;
+		for (uint32_t i = 0; i < Tables; ++i) {
+			double cutoff = 0.95 / max_steps[i]; //(as a fraction of the source's Nyquist rate)
+			//(one extra row, for interpolating past the last phase)
+			for (uint32_t phase = 0; phase <= RESAMPLE_PHASES; ++phase) {
+				float *row = &tables[(i * (RESAMPLE_PHASES + 1) + phase) * RESAMPLE_TAPS];
+				double sum = 0.0;
+				for (uint32_t t = 0; t < RESAMPLE_TAPS; ++t) {
+					//distance from the output position to this tap's source frame:
+					double d = double(t) - double(RESAMPLE_BEFORE) - double(phase) / double(RESAMPLE_PHASES);
+					double sinc = (d == 0.0 ? 1.0 : std::sin(pi * cutoff * d) / (pi * cutoff * d));
+					//Blackman window, reaching zero just past the outermost taps:
+					double w = d / double(RESAMPLE_AFTER + 1);
+					double window = (std::abs(w) >= 1.0 ? 0.0 : 0.42 + 0.5 * std::cos(pi * w) + 0.08 * std::cos(2.0 * pi * w));
+					row[t] = float(sinc * window);
+					sum += row[t];
+				}
+				//(normalized so that a constant signal comes out unchanged)
+				for (uint32_t t = 0; t < RESAMPLE_TAPS; ++t) row[t] = float(row[t] / sum);
+			}
+		}
+		return tables;
+	}();
+
+	uint32_t i = 0;
+	while (i + 1 < Tables && double(step) > double(max_steps[i]) * 4294967296.0) ++i;
+	return &tables[i * (RESAMPLE_PHASES + 1) * RESAMPLE_TAPS];
+}
+
+MixKernel best_mix_kernel() {
+	static MixKernel const best = [](){
+		for (uint32_t k = MaxMixKernel - 1; k > MixKernelScalar; --k) {
+			if (get_mix_mono(MixKernel(k))) return MixKernel(k);
+		}
+		return MixKernelScalar;
+	}();
+	return best;
+}
+
+char const *mix_kernel_name(MixKernel kernel) {
+	if (kernel == MixKernelScalar) return "scalar";
+	if (kernel == MixKernelSSE2) return "sse2";
+	if (kernel == MixKernelAVX2) return "avx2";
+	return "unknown";
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+//Inner loops of the Sound:: mixer.
+//
+//Each mono kernel adds 'count' frames of a mono source into an interleaved stereo (LRLR...) buffer,
+// with a left/right gain that changes linearly across the block:
+//   out[2*k+0] += (gain_l + k * step_l) * in[k]
+//   out[2*k+1] += (gain_r + k * step_r) * in[k]
+//
+//Each stereo kernel does the same for an interleaved stereo source, keeping the channels separate:
+//   out[2*k+0] += (gain_l + k * step_l) * in[2*k+0]
+//   out[2*k+1] += (gain_r + k * step_r) * in[2*k+1]
+//
+//Each tone kernel writes 'count' frames of a phase-modulated sine wave with a fading envelope, starting at frame 'first':
+//   x = float(first + k)
+//   out[k] = (amplitude * max(0, 1 - x * decay)^falloff) * sin(carrier * x + index * sin(modulator * x))
+// (carrier and modulator are in radians per frame; decay is one over the length in frames)
+// sin() here is a polynomial approximation, accurate to about 1e-7 near zero -- plenty for audio.
+//
+//Each resample kernel reads a mono (or interleaved stereo) source at fractional positions, writing 'count' frames:
+//   output frame k is the source at position + k * step (both in frames, as 32.32 fixed point),
+//   filtered with RESAMPLE_TAPS taps from 'table' (see get_resample_table): source frames n-7 ... n+8 for n = floor(position),
+//   with the coefficients interpolated between the two nearest of RESAMPLE_PHASES phases.
+// The caller must make sure all of those source frames exist. The taps are summed in a fixed pattern
+// (see resample_mono_range / resample_stereo_range) that the SIMD versions follow exactly.
+//
+//Each peak kernel measures 'count' frames of interleaved stereo for the output limiter, returning the largest:
+//   peak[k] = max(|in[2*k+0]|, |in[2*k+1]|)
+//
+//Each gain kernel applies a per-frame gain to 'count' frames of interleaved stereo, clamping to +/-ceiling:
+//   out[2*k+c] = min(max(gain[k] * in[2*k+c], -ceiling), ceiling)
+// (min and max here are "(a < b ? a : b)" and "(a > b ? a : b)", as the SIMD instructions do them)
+//
+//All versions compute exactly these operations in exactly this order, so their results match
+// bit-for-bit; the SIMD versions just do several frames at a time and hand the
+// last few frames to the scalar loop.
+
+typedef void (*MixMonoFn)(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r);
+typedef void (*MixStereoFn)(float const *in, float *out, uint32_t count, float gain_l, float gain_r, float step_l, float step_r);
+typedef void (*ResampleFn)(float const *in, float *out, uint32_t count, uint64_t position, uint64_t step, float const *table);
+typedef float (*FramePeakFn)(float const *in, float *peak, uint32_t count);
+typedef void (*ApplyGainFn)(float const *in, float const *gain, float *out, uint32_t count, float ceiling);
+typedef void (*SynthToneFn)(float *out, uint32_t first, uint32_t count, float carrier, float modulator, float index, float decay, float amplitude, uint32_t falloff);
+
+enum MixKernel : uint32_t {
+	MixKernelScalar,
+	MixKernelSSE2,
+	MixKernelAVX2,
+	MaxMixKernel //<-- just used to track # of kernels
+};
+
+//look up a particular kernel; returns nullptr if it wasn't compiled in or this CPU can't run it:
+MixMonoFn get_mix_mono(MixKernel kernel);
+MixStereoFn get_mix_stereo(MixKernel kernel);
+SynthToneFn get_synth_tone(MixKernel kernel);
+ResampleFn get_resample_mono(MixKernel kernel);
+ResampleFn get_resample_stereo(MixKernel kernel);
+FramePeakFn get_frame_peak(MixKernel kernel);
+ApplyGainFn get_apply_gain(MixKernel kernel);
+
+constexpr uint32_t const RESAMPLE_TAPS = 16;
+constexpr uint32_t const RESAMPLE_PHASES = 256;
+constexpr uint32_t const RESAMPLE_BEFORE = 7; //source frames needed before floor(position)...
+constexpr uint32_t const RESAMPLE_AFTER = 8; //...and after
+
+//windowed-sinc filter table for a given step (32.32 fixed point): bigger steps get lower cutoffs, so that
+// skipping through the source quickly doesn't alias. (tables are built on the first call, so make
+// one from a non-real-time thread before the mixer needs them)
+float const *get_resample_table(uint64_t step);
+
+//fastest kernel this CPU can run (checked once, on first call):
+MixKernel best_mix_kernel();
+
+char const *mix_kernel_name(MixKernel kernel);
@@ -0,0 +1,98 @@
+#include "Bundle.hpp"
+#include "read_write_chunk.hpp"
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+
+/*
+ * pack asset files into a bundle (see Bundle.hpp) that the game can map all at once.
+ * reads list of files from command line arguments; each is stored under its name without the directory.
+ *
+ */
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try { //windows doesn't print nice errors for unhandled exceptions, so we need to.
+#endif
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t./pack-bundle <out.bundle> [file1] [file2] ...\n";
+		std::cerr << " will pack file1, file2, ... into \"out.bundle\", each named without its directory (e.g., \"dist/death.opus\" => \"death.opus\").\n";
+		std::cerr.flush();
+		return 1;
+	}
+	std::string outname = argv[1];
+
+	std::vector< char > strings;
+	std::vector< BundleEntry > entries;
+	std::vector< unsigned char > contents;
+
+	for (int i = 2; i < argc; ++i) {
+		std::string path = argv[i];
+		std::string name = path.substr(path.find_last_of("/\\") + 1);
+		for (auto const &entry : entries) {
+			if (std::string(strings.begin() + entry.name_begin, strings.begin() + entry.name_end) == name) {
+				std::cerr << "ERROR: two files named '" << name << "'." << std::endl;
+				return 1;
+			}
+		}
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			std::cerr << "ERROR: failed to open '" << path << "'." << std::endl;
+			return 1;
+		}
+		std::vector< unsigned char > data((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+
+		BundleEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+		//each file starts aligned:
+		contents.resize((contents.size() + BundleAlignment - 1) / BundleAlignment * BundleAlignment, 0);
+		entry.offset = contents.size();
+		entry.size = data.size();
+		entry.hash = bundle_hash(data.data(), data.size());
+		contents.insert(contents.end(), data.begin(), data.end());
+		entries.emplace_back(entry);
+
+		std::cout << "  " << name << ": " << data.size() << " bytes" << std::endl;
+	}
+
+	std::vector< BundleHeader > header(1);
+	header[0].count = uint32_t(entries.size());
+	header[0].toc_hash = bundle_hash(reinterpret_cast< unsigned char const * >(entries.data()), entries.size() * sizeof(BundleEntry),
+		bundle_hash(reinterpret_cast< unsigned char const * >(strings.data()), strings.size()));
+
+	//pad so that dat0's contents start aligned (each of the five chunks has an 8-byte header):
+	size_t unpadded = 5 * 8 + sizeof(BundleHeader) + strings.size() + entries.size() * sizeof(BundleEntry);
+	std::vector< char > pad((BundleAlignment - unpadded % BundleAlignment) % BundleAlignment, 0);
+
+	{
+		std::ofstream out(outname, std::ios::binary);
+		write_chunk("bdl0", header, &out);
+		write_chunk("str0", strings, &out);
+		write_chunk("toc0", entries, &out);
+		write_chunk("pad0", pad, &out);
+		write_chunk("dat0", contents, &out);
+		if (!out) {
+			std::cerr << "ERROR: failed to write '" << outname << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	//read it back, to be sure it loads:
+	Bundle bundle(outname);
+	bundle.verify();
+	std::cout << "Packed " << entries.size() << " files into '" << outname << "'." << std::endl;
+
+	return 0;
+#ifdef _WIN32
+	} catch (std::exception &e) {
+		std::cerr << "UNHANDLED EXCEPTION:\n" << e.what() << std::endl;
+		return 1;
+	}
+#endif
+}
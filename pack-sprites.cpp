@@ -1,5 +1,6 @@
 #include "load_save_png.hpp"
 #include "read_write_chunk.hpp"
+#include "atlas_format.hpp"
 
 #include <glm/glm.hpp>
 
@@ -335,38 +336,78 @@ int main(int argc, char **argv) {
 	std::cout << " done." << std::endl;
 
 	std::cout << "Saving " << outname << ".atlas ..."; std::cout.flush();
-	{ //store ".atlas" file describing final image:
-		std::vector< char > strings;
-
-		struct SpriteData {
-			uint32_t name_begin, name_end;
-			glm::vec2 min_px;
-			glm::vec2 max_px;
-			glm::vec2 anchor_px;
-		};
-		std::vector< SpriteData > datas;
-
-		for (uint32_t si = 0; si < sprites.size(); ++si) {
+	{ //store ".atlas" file describing final image (see atlas_format.hpp):
+		//sprites are listed in name order, so the game can binary-search them:
+		std::vector< uint32_t > order(sprites.size());
+		for (uint32_t si = 0; si < sprites.size(); ++si) order[si] = si;
+		std::sort(order.begin(), order.end(), [&sprites](uint32_t a, uint32_t b) {
+			return sprites[a].name < sprites[b].name;
+		});
+		for (uint32_t i = 1; i < order.size(); ++i) {
+			if (sprites[order[i-1]].name == sprites[order[i]].name) {
+				std::cerr << "ERROR: two sprites named '" << sprites[order[i]].name << "'." << std::endl;
+				return 1;
+			}
+		}
+
+		std::ofstream out(outname + ".atlas", std::ios::binary);
+
+		SpriteAtlasHeader header;
+		header.version = little_endian(SpriteAtlasVersion);
+		header.count = little_endian(uint32_t(sprites.size()));
+		header.tex_width = little_endian(packing.size.x);
+		header.tex_height = little_endian(packing.size.y);
+		{
+			ChunkWriter header_chunk(out, "spr1");
+			header_chunk.write(header);
+		}
+
+		//names, written straight to the file:
+		std::vector< std::pair< uint32_t, uint32_t > > name_ranges(sprites.size());
+		{
+			ChunkWriter strings(out, "str0");
+			for (uint32_t si : order) {
+				name_ranges[si].first = uint32_t(strings.written);
+				strings.write(sprites[si].name.data(), sprites[si].name.size());
+				name_ranges[si].second = uint32_t(strings.written);
+			}
+			//(so the index that follows can be read in place)
+			strings.pad(4);
+		}
+
+		ChunkWriter index(out, "idx1");
+		for (uint32_t si : order) {
 			Sprite const &sprite = sprites[si];
 			glm::uvec2 const &ll = packing.lls[si];
 
-			datas.emplace_back();
-			auto &data = datas.back();
-			data.name_begin = uint32_t(strings.size());
-			strings.insert(strings.end(), sprite.name.begin(), sprite.name.end());
-			data.name_end = uint32_t(strings.size());
-			data.min_px = glm::vec2(ll);
-			data.max_px = glm::vec2(ll + sprite.size);
+			glm::vec2 min_px = glm::vec2(ll);
+			glm::vec2 max_px = glm::vec2(ll + sprite.size);
 			//convert anchor to ll-origin:
-			data.anchor_px = glm::vec2(
+			glm::vec2 anchor_px = glm::vec2(
 				ll.x + sprite.anchor.x,
 				ll.y + sprite.size.y - sprite.anchor.y
 			);
+			glm::vec2 min_tc = min_px / glm::vec2(packing.size);
+			glm::vec2 max_tc = max_px / glm::vec2(packing.size);
+
+			SpriteAtlasEntry entry;
+			entry.name_begin = little_endian(name_ranges[si].first);
+			entry.name_end = little_endian(name_ranges[si].second);
+			for (uint32_t c = 0; c < 2; ++c) {
+				entry.min_px[c] = little_endian(min_px[c]);
+				entry.max_px[c] = little_endian(max_px[c]);
+				entry.anchor_px[c] = little_endian(anchor_px[c]);
+				entry.min_tc[c] = little_endian(min_tc[c]);
+				entry.max_tc[c] = little_endian(max_tc[c]);
+			}
+			index.write(entry);
 		}
+		index.finish();
 
-		std::ofstream out(outname + ".atlas", std::ios::binary);
-		write_chunk("str0", strings, &out);
-		write_chunk("spr0", datas, &out);
+		if (!out) {
+			std::cerr << "ERROR: failed to write '" << outname << ".atlas'." << std::endl;
+			return 1;
+		}
 	}
 	std::cout << " done." << std::endl;
 
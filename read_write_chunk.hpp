@@ -2,26 +2,52 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
-// |sz|sz|sz|sz| <-- four byte (native endian) size
+// |sz|sz|sz|sz| <-- four byte (little-endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
 
+//convert between native and little-endian byte order (the same swap goes both ways; does nothing on little-endian machines):
+inline bool host_is_little_endian() {
+	uint32_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	return first == 1;
+}
+inline uint32_t little_endian(uint32_t value) {
+	if (host_is_little_endian()) return value;
+	return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+inline float little_endian(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	bits = little_endian(bits);
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+struct ChunkHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t size = 0;
+};
+static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+//chunks bigger than this are assumed to be damaged (rather than allocated or trusted):
+constexpr uint32_t const MaxChunkSize = 1U << 30;
+
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-
 	ChunkHeader header;
 	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
 		throw std::runtime_error("Failed to read chunk header");
@@ -29,13 +55,17 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	if (std::string(header.magic,4) != magic) {
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
+	header.size = little_endian(header.size);
 
 	if (header.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
+	if (header.size > MaxChunkSize) {
+		throw std::runtime_error("Chunk '" + magic + "' is too large (" + std::to_string(header.size) + " bytes)");
+	}
 
 	to.resize(header.size / sizeof(T));
-	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
+	if (!to.empty() && !from.read(reinterpret_cast< char * >(to.data()), to.size() * sizeof(T))) {
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
@@ -48,18 +78,195 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
 	ChunkHeader header;
 	header.magic[0] = magic[0];
 	header.magic[1] = magic[1];
 	header.magic[2] = magic[2];
 	header.magic[3] = magic[3];
-	header.size = uint32_t(from.size() * sizeof(T));
+	header.size = little_endian(uint32_t(from.size() * sizeof(T)));
 
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//A read-only array of T that lives somewhere else (e.g., in a memory-mapped file):
+template< typename T >
+struct ChunkView {
+	T const *data = nullptr;
+	size_t size = 0;
+
+	T const *begin() const { return data; }
+	T const *end() const { return data + size; }
+	T const &operator[](size_t i) const { assert(i < size); return data[i]; }
+	bool empty() const { return size == 0; }
+};
+
+//Reads chunks, in the same format as read_chunk, from a buffer that is already in memory (e.g., a
+// memory-mapped file or a Bundle slice) -- without copying them, when it can.
+//Every chunk is checked to fit in the buffer and to be no larger than 'max_size'; reading a chunk
+// as T also checks that its size is a multiple of sizeof(T). All of these throw on failure.
+//  ChunkReader reader(bytes, size, "sprites.atlas");
+//  ChunkView< char > names = reader.view< char >("str0");
+struct ChunkReader {
+	ChunkReader(void const *data_, size_t size_, std::string const &name_, uint32_t max_size_ = MaxChunkSize)
+		: data(reinterpret_cast< unsigned char const * >(data_)), size(size_), name(name_), max_size(max_size_) { }
+
+	//is there anything left to read?
+	bool done() const { return at == size; }
+
+	//magic number of the next chunk (without moving past it):
+	std::string peek() const {
+		ChunkHeader header = next_header();
+		return std::string(header.magic, 4);
+	}
+
+	//the next chunk, which must have the given magic number, as a view of the buffer;
+	// also throws if the chunk's contents aren't aligned for T (see read(), below, for chunks that may not be):
+	template< typename T >
+	ChunkView< T > view(std::string const &magic) {
+		unsigned char const *bytes;
+		size_t count = next< T >(magic, &bytes);
+		if (reinterpret_cast< uintptr_t >(bytes) % alignof(T) != 0) {
+			throw std::runtime_error("Chunk '" + magic + "' in '" + name + "' isn't aligned for its contents.");
+		}
+		ChunkView< T > ret;
+		ret.data = reinterpret_cast< T const * >(bytes);
+		ret.size = count;
+		return ret;
+	}
+
+	//the next chunk, as a view of the buffer if it is aligned for T, otherwise as a view of a copy in 'storage':
+	template< typename T >
+	ChunkView< T > read(std::string const &magic, std::vector< T > *storage) {
+		assert(storage);
+		unsigned char const *bytes;
+		size_t count = next< T >(magic, &bytes);
+		ChunkView< T > ret;
+		ret.size = count;
+		if (reinterpret_cast< uintptr_t >(bytes) % alignof(T) == 0) {
+			ret.data = reinterpret_cast< T const * >(bytes);
+		} else {
+			storage->resize(count);
+			if (count) std::memcpy(storage->data(), bytes, count * sizeof(T));
+			ret.data = storage->data();
+		}
+		return ret;
+	}
+
+	//move past the next chunk, whatever it is:
+	void skip() {
+		ChunkHeader header = next_header();
+		at += sizeof(ChunkHeader) + header.size;
+	}
+
+	//skip ahead to the next chunk with the given magic number; returns false (having read everything) if there isn't one:
+	bool find(std::string const &magic) {
+		while (!done()) {
+			if (peek() == magic) return true;
+			skip();
+		}
+		return false;
+	}
+
+	unsigned char const *data;
+	size_t size;
+	std::string name; //for error messages
+	uint32_t max_size;
+	size_t at = 0; //start of the next chunk
+
+private:
+	//(if 'magic' is given, checks it first -- a wrong magic number explains a strange size better than the other way around)
+	ChunkHeader next_header(std::string const *magic = nullptr) const {
+		ChunkHeader header;
+		if (size - at < sizeof(header)) {
+			throw std::runtime_error("Failed to read chunk header in '" + name + "' (at byte " + std::to_string(at) + ").");
+		}
+		std::memcpy(&header, data + at, sizeof(header));
+		header.size = little_endian(header.size);
+		if (magic && std::string(header.magic, 4) != *magic) {
+			throw std::runtime_error("Expected chunk '" + *magic + "' in '" + name + "', found '" + std::string(header.magic, 4) + "'.");
+		}
+		if (header.size > max_size) {
+			throw std::runtime_error("Chunk '" + std::string(header.magic, 4) + "' in '" + name + "' is too large (" + std::to_string(header.size) + " bytes).");
+		}
+		if (size - at - sizeof(header) < header.size) {
+			throw std::runtime_error("Chunk '" + std::string(header.magic, 4) + "' in '" + name + "' runs past the end of the file.");
+		}
+		return header;
+	}
+
+	template< typename T >
+	size_t next(std::string const &magic, unsigned char const **bytes) {
+		assert(magic.size() == 4);
+		ChunkHeader header = next_header(&magic);
+		if (header.size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk '" + magic + "' in '" + name + "' not divisible by element size.");
+		}
+		*bytes = data + at + sizeof(header);
+		at += sizeof(header) + header.size;
+		return header.size / sizeof(T);
+	}
+};
+
+//Writes one chunk, in the same format as write_chunk, a piece at a time -- so the contents never need
+// to be gathered into one vector. The header's size is filled in by finish() (or the destructor), so
+// 'to' must be seekable (e.g., a std::ofstream):
+//  ChunkWriter names(out, "str0");
+//  for (auto const &sprite : sprites) names.write(sprite.name.data(), sprite.name.size());
+//  names.finish();
+struct ChunkWriter {
+	ChunkWriter(std::ostream &to_, std::string const &magic_) : to(to_), magic(magic_) {
+		assert(magic.size() == 4);
+		ChunkHeader header;
+		std::memcpy(header.magic, magic.data(), 4);
+		header_at = to.tellp();
+		to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	}
+	~ChunkWriter() {
+		if (!finished) finish();
+	}
+	ChunkWriter(ChunkWriter const &) = delete;
+	ChunkWriter &operator=(ChunkWriter const &) = delete;
+
+	//(throws, before writing anything, if the chunk would grow past MaxChunkSize)
+	template< typename T >
+	void write(T const *from, size_t count) {
+		assert(!finished);
+		if (count > (MaxChunkSize - written) / sizeof(T)) {
+			throw std::runtime_error("Chunk '" + magic + "' is too large (over " + std::to_string(MaxChunkSize) + " bytes).");
+		}
+		to.write(reinterpret_cast< char const * >(from), count * sizeof(T));
+		written += count * sizeof(T);
+	}
+	template< typename T >
+	void write(T const &from) {
+		write(&from, 1);
+	}
+
+	//write zeros until the contents are a multiple of 'alignment' long (so, if this chunk's contents
+	// started aligned, the next chunk's will too, once 'alignment' is no more than the 8-byte header):
+	void pad(size_t alignment) {
+		while (written % alignment != 0) write(char(0));
+	}
+
+	//go back and fill in the size:
+	// (doesn't throw -- write() keeps the size in range -- so it is safe to call from the destructor;
+	//  like any other stream write, check 'to' afterward to see if it worked)
+	void finish() {
+		assert(!finished);
+		finished = true;
+		assert(written <= MaxChunkSize);
+		uint32_t chunk_size = little_endian(uint32_t(written));
+		std::ostream::pos_type end = to.tellp();
+		to.seekp(header_at + std::streamoff(offsetof(ChunkHeader, size)));
+		to.write(reinterpret_cast< char const * >(&chunk_size), sizeof(chunk_size));
+		to.seekp(end);
+	}
+
+	std::ostream &to;
+	std::string magic;
+	std::ostream::pos_type header_at;
+	size_t written = 0;
+	bool finished = false;
+};
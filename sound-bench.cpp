@@ -0,0 +1,637 @@
+//sound-bench: stress tests and microbenchmarks for the Sound:: mixer.
+//
+// usage:
+//   sound-bench stress [seconds] [plays-per-second] [voice-limit] [block-frames]
+//   sound-bench kernels [voices] [blocks]
+//   sound-bench voices [block-frames] [seconds]
+//   sound-bench load file.opus [file.opus ...]
+//   sound-bench render [script.txt] [out.wav]
+//
+// 'stress' fires lots of Sound::play() calls (plus volume/pan/stop changes on some of the
+// resulting PlayingSamples) from this thread while the audio callback runs, then reports
+// how long the game-side calls took and whether the callback ever overran its budget.
+// (with the defaults, far more blips are requested than there are voices, so voice stealing
+//  and stale handles get exercised too)
+//
+// 'kernels' times each (mono and stereo) mixing kernel in mix_kernels.hpp on the same data, reports
+// voices mixed per millisecond, and checks the SIMD output against the scalar output. It does the same
+// for the tone kernels, and also checks their sine approximation against std::sin, and for the resampling
+// kernels (reading each voice's source at 44.1kHz -> 48kHz and at an octave up), and for the output
+// limiter's peak-measuring and gain kernels.
+//
+// 'voices' renders (offline) 32, 256, and 1024 looping voices whose pan and volume are all ramping,
+// and reports the cost per block and per voice -- i.e., the mixer's per-voice overhead (gain updates,
+// bookkeeping) on top of the kernels. Small blocks make that overhead easier to see. It then does the same
+// with their bus muted, which shows what inaudible ("virtual") voices cost.
+//
+// 'load' compares loading each file as a Decoded and as a Streamed sample (or, for .pcm files, a Mapped
+// sample): time until the sample is ready to play, and how much decoded audio it keeps in memory.
+//
+// 'render' runs the mixer offline (no audio device needed) from a script of timed events, as fast
+// as it can go. It reports the real-time factor and a checksum of the output (so output changes can be
+// caught on machines without a sound card), and can save what it rendered as a .wav file.
+// Script lines ('#' starts a comment; times are in seconds):
+//   sample NAME FILE [decoded|streamed|cached|mapped] -- load a sample (FILE may be BUNDLE:NAME, for a file in a bundle)
+//   tone NAME HZ SECONDS                         -- make a sine-wave sample
+//   bus NAME music|sfx|ui                        -- mix a sample into a bus (default: sfx)
+//   ducks NAME                                   -- mark a sample as a sidechain trigger
+//   TIME play NAME [volume] [pan]                -- play a sample (later lines naming it refer to this playback)
+//   TIME loop NAME [volume] [pan]
+//   TIME stop NAME [ramp]
+//   TIME volume NAME VOLUME [ramp]
+//   TIME pan NAME PAN [ramp]
+//   TIME bus-volume BUS VOLUME [ramp]            -- bus controls (BUS is music, sfx, or ui)
+//   TIME duck BUS LEVEL [ramp]
+//   TIME mute BUS / TIME unmute BUS
+//   TIME lowpass BUS HZ                          -- effect slot 0 (HZ of 0 clears it)
+//   TIME reverb BUS ROOM-SIZE WET                -- effect slot 1 (WET of 0 clears it)
+//   TIME sidechain BUS LEVEL [release]           -- duck BUS to LEVEL under triggers (LEVEL of 1 clears it)
+//   TIME limiter on|off [ceiling] [release]      -- set up the output limiter
+//   TIME end                                     -- stop rendering
+// Without a script, 64 tones are looped for 60 seconds.
+
+#include "Sound.hpp"
+#include "mix_kernels.hpp"
+#include "load_wav.hpp"
+#include "Bundle.hpp"
+
+#include <SDL.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <memory>
+#include <cstdio>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+int stress(int argc, char **argv) {
+	float seconds = 5.0f;
+	uint32_t plays_per_second = 5000;
+	uint32_t voice_limit = 64;
+	uint32_t block_frames = 1024;
+	if (argc > 0) seconds = std::stof(argv[0]);
+	if (argc > 1) plays_per_second = uint32_t(std::stoul(argv[1]));
+	if (argc > 2) voice_limit = uint32_t(std::stoul(argv[2]));
+	if (argc > 3) block_frames = uint32_t(std::stoul(argv[3]));
+
+	Sound::init(voice_limit, block_frames);
+	Sound::set_steal_policy(Sound::StealQuietest);
+
+	//a short blip, made the same way as the flap sounds in FlappyMode.cpp:
+	std::vector< float > data(size_t(48000 * 0.05f), 0.0f);
+	for (uint32_t i = 0; i < data.size(); ++i) {
+		float t = i / float(48000);
+		data[i] = std::sin(3.1415926f * 2.0f * 440.0f * t + std::sin(3.1415926f * 2.0f * 450.0f * t));
+		data[i] *= 0.01f * std::pow(std::max(0.0f, (1.0f - t / 0.05f)), 2.0f);
+	}
+	Sound::Sample blip(data);
+
+	std::cout << "Playing " << plays_per_second << " samples per second for " << seconds << " seconds..." << std::endl;
+
+	auto start = Clock::now();
+	auto next = start;
+	auto step = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(1.0 / plays_per_second));
+
+	uint64_t plays = 0;
+	double max_call_us = 0.0;
+	double total_call_us = 0.0;
+	uint64_t stale_stops = 0;
+	std::vector< Sound::PlayingSample > held;
+
+	while (Clock::now() - start < std::chrono::duration< float >(seconds)) {
+		auto before = Clock::now();
+		Sound::PlayingSample playing = Sound::play(blip, 1.0f, (plays % 3) * 0.5f - 0.5f, uint32_t(plays % 4));
+		//poke at some of the playing samples as well:
+		if (plays % 7 == 0) playing.set_volume(0.5f);
+		if (plays % 11 == 0) playing.set_pan(-1.0f, 0.01f);
+		if (plays % 13 == 0) held.emplace_back(playing);
+		if (held.size() > 16) {
+			//(many of these will have finished or been stolen by now; stop() must not care)
+			if (held.front().stopped()) stale_stops += 1;
+			held.front().stop(0.005f);
+			held.erase(held.begin());
+		}
+		double call_us = std::chrono::duration< double, std::micro >(Clock::now() - before).count();
+		max_call_us = std::max(max_call_us, call_us);
+		total_call_us += call_us;
+		plays += 1;
+		if (plays % 1000 == 0) Sound::update(); //(as the game would, once per frame)
+
+		next += step;
+		while (Clock::now() < next) { /* spin; sleeping is too coarse at this rate */ }
+	}
+
+	//let the queue drain before reading the counters:
+	SDL_Delay(100);
+
+	Sound::Stats stats = Sound::get_stats();
+	std::cout << "  game-side calls: " << plays << " plays, mean " << (plays ? total_call_us / plays : 0.0) << " us, max " << max_call_us << " us." << std::endl;
+	std::cout << "  callbacks: " << stats.callbacks << ", overruns: " << stats.overruns << ", max callback: " << stats.max_callback_ms << " ms, block size: " << stats.block_frames << " frames." << std::endl;
+	std::cout << "  dropped commands: " << stats.dropped_commands << ", stolen voices: " << stats.stolen_voices << ", stops on stale handles: " << stale_stops << std::endl;
+	std::cout << "  callback time: median " << stats.callback_us.percentile(0.5f) << " us, 99% " << stats.callback_us.percentile(0.99f) << " us; jitter 99% " << stats.jitter_us.percentile(0.99f) << " us." << std::endl;
+	std::cout << "  voices: peak " << stats.peak_voices << ", average " << stats.average_voices << "; clipped samples: " << stats.clipped_samples << std::endl;
+	std::cout << "  limiter: " << stats.limited_frames << " frames turned down (in " << stats.limited_callbacks << " blocks), by at most " << stats.max_gain_reduction_db << " dB." << std::endl;
+
+	Sound::shutdown();
+
+	if (stats.callbacks == 0) {
+		std::cout << "NOTE: audio callback never ran (no audio device?)." << std::endl;
+		return 1;
+	}
+	return (stats.overruns == 0 ? 0 : 1);
+}
+
+int kernels(int argc, char **argv) {
+	uint32_t voices = 256;
+	uint32_t blocks = 200;
+	if (argc > 0) voices = uint32_t(std::stoul(argv[0]));
+	if (argc > 1) blocks = uint32_t(std::stoul(argv[1]));
+
+	constexpr uint32_t const Frames = 1024;
+	//odd-length tails on some voices, so the end-of-sample path is timed too:
+	auto voice_frames = [](uint32_t v) { return (v % 4 == 3 ? Frames - 1 - (v % 7) : Frames); };
+
+	std::mt19937 mt(0x5eed);
+	std::uniform_real_distribution< float > dist(-1.0f, 1.0f);
+	std::vector< float > in(2 * Frames * voices); //(enough for stereo sources)
+	for (auto &x : in) x = dist(mt);
+	std::vector< float > gains(4 * voices);
+	for (auto &g : gains) g = 0.5f + 0.5f * dist(mt);
+
+	for (uint32_t channels = 1; channels <= 2; ++channels) {
+		std::vector< float > reference;
+		std::cout << "Mixing " << voices << " " << (channels == 1 ? "mono" : "stereo") << " voices x " << blocks << " blocks of " << Frames << " frames:" << std::endl;
+		for (uint32_t k = 0; k < MaxMixKernel; ++k) {
+			//(mono and stereo kernels have the same signature)
+			MixMonoFn fn = (channels == 1 ? get_mix_mono(MixKernel(k)) : get_mix_stereo(MixKernel(k)));
+			if (!fn) {
+				std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": not available on this CPU." << std::endl;
+				continue;
+			}
+			std::vector< float > out(2 * Frames, 0.0f);
+			auto before = Clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				for (uint32_t v = 0; v < voices; ++v) {
+					float const *g = &gains[4 * v];
+					fn(&in[channels * Frames * v], out.data(), voice_frames(v), g[0], g[1], (g[2] - g[0]) / Frames, (g[3] - g[1]) / Frames);
+				}
+				//keep the sum bounded (and the compiler honest):
+				if (b + 1 < blocks) std::memset(out.data(), 0, out.size() * sizeof(float));
+			}
+			double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+			std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": " << (voices * double(blocks)) / ms << " voices/ms";
+			if (reference.empty()) {
+				reference = out;
+			} else {
+				float max_diff = 0.0f;
+				for (uint32_t i = 0; i < out.size(); ++i) {
+					max_diff = std::max(max_diff, std::abs(out[i] - reference[i]));
+				}
+				bool exact = (std::memcmp(out.data(), reference.data(), out.size() * sizeof(float)) == 0);
+				std::cout << " (vs scalar: " << (exact ? "bit-exact" : "max difference " + std::to_string(max_diff)) << ")";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	//tone kernels, on the same parameters as the menu "click" (Sound::Tone):
+	{
+		float const radians_per_frame = 2.0f * 3.1415926f / 48000.0f;
+		float const carrier = 440.0f * radians_per_frame, modulator = 450.0f * radians_per_frame, decay = 1.0f / 9600.0f;
+		std::vector< float > reference;
+		std::cout << "Synthesizing " << voices << " tones x " << blocks << " blocks of " << Frames << " frames:" << std::endl;
+		for (uint32_t k = 0; k < MaxMixKernel; ++k) {
+			SynthToneFn fn = get_synth_tone(MixKernel(k));
+			if (!fn) {
+				std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": not available on this CPU." << std::endl;
+				continue;
+			}
+			std::vector< float > out(Frames * blocks);
+			auto before = Clock::now();
+			for (uint32_t v = 0; v < voices; ++v) {
+				for (uint32_t b = 0; b < blocks; ++b) {
+					fn(&out[Frames * b], Frames * b, Frames, carrier, modulator, 1.0f, decay, 0.3f, 2);
+				}
+			}
+			double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+			std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": " << (voices * double(blocks)) / ms << " tone-blocks/ms";
+			if (reference.empty()) {
+				reference = out;
+				//check the approximation against the standard library, too:
+				float max_error = 0.0f;
+				for (uint32_t i = 0; i < out.size(); ++i) {
+					float x = float(i);
+					float expected = 0.3f * std::pow(std::max(0.0f, 1.0f - x * decay), 2.0f) * float(std::sin(double(carrier) * x + std::sin(double(modulator) * x)));
+					max_error = std::max(max_error, std::abs(out[i] - expected));
+				}
+				std::cout << " (vs std::sin: max difference " << max_error << ")";
+			} else {
+				bool exact = (std::memcmp(out.data(), reference.data(), out.size() * sizeof(float)) == 0);
+				std::cout << " (vs scalar: " << (exact ? "bit-exact" : "DIFFERENT") << ")";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	//resampling kernels, reading the (random) source data at two different speeds:
+	for (double speed : { 44100.0 / 48000.0, 2.0 }) {
+		uint64_t const step = uint64_t(speed * 4294967296.0);
+		float const *table = get_resample_table(step);
+		//(voices read within their own source, RESAMPLE_BEFORE frames in, from a different fraction each)
+		uint32_t const count = uint32_t((uint64_t(Frames - RESAMPLE_BEFORE - RESAMPLE_AFTER - 1) << 32) / step);
+		for (uint32_t channels = 1; channels <= 2; ++channels) {
+			std::vector< float > reference;
+			std::cout << "Resampling " << voices << " " << (channels == 1 ? "mono" : "stereo") << " voices at " << speed << "x, " << blocks << " blocks of " << count << " frames:" << std::endl;
+			for (uint32_t k = 0; k < MaxMixKernel; ++k) {
+				ResampleFn fn = (channels == 1 ? get_resample_mono(MixKernel(k)) : get_resample_stereo(MixKernel(k)));
+				if (!fn) {
+					std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": not available on this CPU." << std::endl;
+					continue;
+				}
+				std::vector< float > out(channels * count * voices);
+				auto before = Clock::now();
+				for (uint32_t b = 0; b < blocks; ++b) {
+					for (uint32_t v = 0; v < voices; ++v) {
+						uint64_t position = (uint64_t(RESAMPLE_BEFORE) << 32) | (uint64_t(v) * 0x9e3779b9ULL & 0xffffffffULL);
+						fn(&in[channels * Frames * v], &out[channels * count * v], count, position, step, table);
+					}
+				}
+				double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+				std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": " << (voices * double(blocks)) / ms << " voices/ms";
+				if (reference.empty()) {
+					reference = out;
+				} else {
+					bool exact = (std::memcmp(out.data(), reference.data(), out.size() * sizeof(float)) == 0);
+					std::cout << " (vs scalar: " << (exact ? "bit-exact" : "DIFFERENT") << ")";
+				}
+				std::cout << std::endl;
+			}
+		}
+	}
+
+	//limiter kernels, with a ceiling well below the (random) data's peaks:
+	{
+		std::vector< float > gain(Frames);
+		for (uint32_t i = 0; i < Frames; ++i) gain[i] = 0.5f + 0.5f * std::abs(dist(mt));
+		std::cout << "Limiting " << voices << " x " << blocks << " blocks of " << Frames << " frames:" << std::endl;
+		std::vector< float > reference;
+		for (uint32_t k = 0; k < MaxMixKernel; ++k) {
+			FramePeakFn peak_fn = get_frame_peak(MixKernel(k));
+			ApplyGainFn gain_fn = get_apply_gain(MixKernel(k));
+			if (!peak_fn || !gain_fn) {
+				std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": not available on this CPU." << std::endl;
+				continue;
+			}
+			std::vector< float > peaks(Frames * voices), out(2 * Frames * voices), largest(voices);
+			auto before = Clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				for (uint32_t v = 0; v < voices; ++v) {
+					largest[v] = peak_fn(&in[2 * Frames * v], &peaks[Frames * v], voice_frames(v));
+					gain_fn(&in[2 * Frames * v], gain.data(), &out[2 * Frames * v], voice_frames(v), 0.75f);
+				}
+			}
+			double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+			std::cout << "  " << mix_kernel_name(MixKernel(k)) << ": " << (voices * double(blocks)) / ms << " blocks/ms";
+			//(everything the kernels wrote, in one place to compare)
+			std::vector< float > all(peaks);
+			all.insert(all.end(), out.begin(), out.end());
+			all.insert(all.end(), largest.begin(), largest.end());
+			if (reference.empty()) {
+				reference = all;
+			} else {
+				bool exact = (std::memcmp(all.data(), reference.data(), all.size() * sizeof(float)) == 0);
+				std::cout << " (vs scalar: " << (exact ? "bit-exact" : "DIFFERENT") << ")";
+			}
+			std::cout << std::endl;
+		}
+	}
+	return 0;
+}
+
+int voices(int argc, char **argv) {
+	uint32_t block_frames = 64;
+	float seconds = 10.0f;
+	if (argc > 0) block_frames = uint32_t(std::stoul(argv[0]));
+	if (argc > 1) seconds = std::stof(argv[1]);
+
+	std::vector< float > data(48000 / 10);
+	for (uint32_t i = 0; i < data.size(); ++i) {
+		data[i] = 0.001f * std::sin(3.1415926f * 2.0f * 440.0f * (i / 48000.0f));
+	}
+
+	for (bool muted : {false, true})
+	for (uint32_t count : {32, 256, 1024}) {
+		Sound::init_offline(count, block_frames);
+		if (muted) Sound::set_bus_muted(Sound::BusSFX, true, 0.0f);
+		uint32_t blocks = uint32_t(seconds * 48000.0f) / block_frames;
+		{
+			Sound::Sample tone(data);
+			std::vector< Sound::PlayingSample > playing;
+			for (uint32_t v = 0; v < count; ++v) {
+				float pan = (v % 9) * 0.25f - 1.0f;
+				playing.emplace_back(Sound::loop(tone, 0.5f, pan));
+				//slow ramps, so every voice's gains change every block:
+				playing.back().set_pan(-pan, seconds);
+				playing.back().set_volume(1.0f, seconds);
+			}
+
+			std::vector< float > out(2 * block_frames);
+			auto before = Clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				Sound::render(out.data(), block_frames);
+			}
+			double ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+			std::cout << "  " << count << (muted ? " muted" : "") << " voices: " << 1000.0 * ms / blocks << " us/block, "
+				<< 1.0e6 * ms / (double(blocks) * count) << " ns/voice/block." << std::endl;
+			for (auto &p : playing) p.stop(0.0f);
+		}
+		Sound::shutdown();
+	}
+	return 0;
+}
+
+int load(int argc, char **argv) {
+	if (argc < 1) {
+		std::cerr << "'load' needs at least one .opus or .pcm file." << std::endl;
+		return 1;
+	}
+	Sound::init();
+	double total_decoded_ms = 0.0, total_streamed_ms = 0.0;
+	size_t total_decoded_bytes = 0;
+	for (int i = 0; i < argc; ++i) {
+		std::string filename = argv[i];
+
+		auto before = Clock::now();
+		size_t decoded_bytes;
+		{
+			Sound::Sample decoded(filename, Sound::Sample::Decoded);
+			decoded_bytes = decoded.data.size() * sizeof(float);
+		}
+		double decoded_ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+		//.pcm files can't be streamed, but can be mapped (which, like streaming, keeps no audio in memory up front):
+		bool pcm = (filename.size() >= 4 && filename.substr(filename.size()-4) == ".pcm");
+		before = Clock::now();
+		Sound::Sample streamed(filename, (pcm ? Sound::Sample::Mapped : Sound::Sample::Streamed));
+		double streamed_ms = std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+
+		std::cout << "  " << filename << ": decoded " << decoded_ms << " ms / " << decoded_bytes / 1024 << " KiB; " << (pcm ? "mapped " : "streamed ") << streamed_ms << " ms to open." << std::endl;
+		total_decoded_ms += decoded_ms;
+		total_streamed_ms += streamed_ms;
+		total_decoded_bytes += decoded_bytes;
+	}
+	std::cout << "Total: decoded " << total_decoded_ms << " ms / " << total_decoded_bytes / 1024 << " KiB; streamed/mapped " << total_streamed_ms << " ms (plus a small fixed-size decode ring per stream)." << std::endl;
+	Sound::shutdown();
+	return 0;
+}
+
+int render(int argc, char **argv) {
+	std::string script_text;
+	if (argc > 0) {
+		std::ifstream file(argv[0]);
+		if (!file) {
+			std::cerr << "Failed to open script '" << argv[0] << "'." << std::endl;
+			return 1;
+		}
+		std::ostringstream text;
+		text << file.rdbuf();
+		script_text = text.str();
+	} else {
+		std::ostringstream text;
+		for (uint32_t i = 0; i < 64; ++i) {
+			text << "tone t" << i << " " << (110.0f + 20.0f * i) << " " << (0.5f + 0.1f * (i % 7)) << "\n";
+			text << (0.05f * i) << " loop t" << i << " 0.02 " << ((i % 5) * 0.5f - 1.0f) << "\n";
+			if (i % 4 == 0) text << (30.0f + 0.1f * i) << " pan t" << i << " 0.0 2.0\n";
+		}
+		text << "60 end\n";
+		script_text = text.str();
+	}
+	std::string out_filename = (argc > 1 ? argv[1] : "");
+
+	Sound::init_offline();
+
+	struct Event {
+		double time = 0.0;
+		std::string verb;
+		std::string name;
+		float a = NAN, b = NAN; //optional arguments (NaN == not given)
+	};
+	std::vector< Event > events;
+	std::map< std::string, std::unique_ptr< Bundle > > bundles; //(declared before 'samples', so outlives them)
+	std::map< std::string, std::unique_ptr< Sound::Sample > > samples;
+	double end_time = 0.0;
+	std::map< std::string, Sound::Bus > const bus_names = {
+		{"music", Sound::BusMusic}, {"sfx", Sound::BusSFX}, {"ui", Sound::BusUI}
+	};
+	std::set< std::string > const bus_verbs = { "bus-volume", "duck", "mute", "unmute", "lowpass", "reverb", "sidechain" };
+
+	std::istringstream script(script_text);
+	std::string line;
+	uint32_t line_number = 0;
+	while (std::getline(script, line)) {
+		line_number += 1;
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string first;
+		if (!(words >> first)) continue;
+		if (first == "sample") {
+			std::string name, file, mode = "decoded";
+			words >> name >> file >> mode;
+			Sound::Sample::LoadMode load_mode = Sound::Sample::Decoded;
+			if (mode == "streamed") load_mode = Sound::Sample::Streamed;
+			else if (mode == "cached") load_mode = Sound::Sample::Cached;
+			else if (mode == "mapped") load_mode = Sound::Sample::Mapped;
+			auto colon = file.rfind(':');
+			if (colon != std::string::npos && colon > 1) { //(not a drive letter)
+				std::string bundle_file = file.substr(0, colon);
+				std::unique_ptr< Bundle > &bundle = bundles[bundle_file];
+				if (!bundle) bundle.reset(new Bundle(bundle_file));
+				samples[name].reset(new Sound::Sample(*bundle, file.substr(colon + 1), load_mode));
+			} else {
+				samples[name].reset(new Sound::Sample(file, load_mode));
+			}
+		} else if (first == "tone") {
+			std::string name;
+			float hz = 440.0f, seconds = 1.0f;
+			words >> name >> hz >> seconds;
+			std::vector< float > data(size_t(48000 * seconds));
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				data[i] = 0.5f * std::sin(3.1415926f * 2.0f * hz * (i / 48000.0f));
+			}
+			samples[name].reset(new Sound::Sample(data));
+		} else if (first == "bus") {
+			std::string name, bus;
+			words >> name >> bus;
+			if (!samples.count(name) || !bus_names.count(bus)) {
+				std::cerr << "Script line " << line_number << ": expecting a sample name and a bus name." << std::endl;
+				return 1;
+			}
+			samples[name]->bus = bus_names.at(bus);
+		} else if (first == "ducks") {
+			std::string name;
+			words >> name;
+			if (!samples.count(name)) {
+				std::cerr << "Script line " << line_number << ": no sample named '" << name << "'." << std::endl;
+				return 1;
+			}
+			samples[name]->ducks = true;
+		} else {
+			Event event;
+			event.time = std::stod(first);
+			std::string a, b;
+			words >> event.verb >> event.name >> a >> b;
+			if (!a.empty()) event.a = std::stof(a);
+			if (!b.empty()) event.b = std::stof(b);
+			if (bus_verbs.count(event.verb)) {
+				if (!bus_names.count(event.name)) {
+					std::cerr << "Script line " << line_number << ": no bus named '" << event.name << "'." << std::endl;
+					return 1;
+				}
+			} else if (event.verb == "limiter") {
+				if (event.name != "on" && event.name != "off") {
+					std::cerr << "Script line " << line_number << ": expecting 'limiter on' or 'limiter off'." << std::endl;
+					return 1;
+				}
+			} else if (event.verb != "end" && !samples.count(event.name)) {
+				std::cerr << "Script line " << line_number << ": no sample named '" << event.name << "'." << std::endl;
+				return 1;
+			}
+			end_time = std::max(end_time, event.time);
+			events.emplace_back(event);
+		}
+	}
+	std::stable_sort(events.begin(), events.end(), [](Event const &x, Event const &y) { return x.time < y.time; });
+
+	//render up to each event, then apply it:
+	uint64_t total_frames = uint64_t(end_time * 48000.0);
+	std::vector< float > out(2 * total_frames, 0.0f);
+	std::map< std::string, Sound::PlayingSample > playing;
+	uint64_t rendered = 0;
+	double render_ms = 0.0;
+	auto render_to = [&](uint64_t frame) {
+		if (frame <= rendered) return;
+		auto before = Clock::now();
+		Sound::render(&out[2 * rendered], uint32_t(frame - rendered));
+		render_ms += std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+		rendered = frame;
+	};
+	for (auto const &event : events) {
+		render_to(uint64_t(event.time * 48000.0));
+		if (bus_verbs.count(event.verb)) {
+			Sound::Bus bus = bus_names.at(event.name);
+			float ramp = (std::isnan(event.b) ? 1.0f / 60.0f : event.b);
+			if (event.verb == "bus-volume") Sound::set_bus_volume(bus, event.a, ramp);
+			else if (event.verb == "duck") Sound::set_bus_duck(bus, event.a, ramp);
+			else if (event.verb == "mute") Sound::set_bus_muted(bus, true);
+			else if (event.verb == "unmute") Sound::set_bus_muted(bus, false);
+			else if (event.verb == "lowpass") {
+				Sound::Effect effect;
+				if (event.a > 0.0f) {
+					effect.type = Sound::Effect::LowPass;
+					effect.cutoff_hz = event.a;
+				}
+				Sound::set_bus_effect(bus, 0, effect);
+			} else if (event.verb == "reverb") {
+				Sound::Effect effect;
+				if (event.b > 0.0f) {
+					effect.type = Sound::Effect::Reverb;
+					effect.room_size = event.a;
+					effect.wet = event.b;
+				}
+				Sound::set_bus_effect(bus, 1, effect);
+			} else if (event.verb == "sidechain") {
+				if (event.a >= 1.0f) {
+					Sound::clear_sidechain(bus);
+				} else {
+					Sound::Sidechain sidechain;
+					sidechain.level = event.a;
+					if (!std::isnan(event.b)) sidechain.release = event.b;
+					Sound::set_sidechain(bus, sidechain);
+				}
+			}
+			continue;
+		}
+		if (event.verb == "limiter") {
+			Sound::set_limiter(event.name == "on", std::isnan(event.a) ? 0.98f : event.a, std::isnan(event.b) ? 0.1f : event.b);
+			continue;
+		}
+		Sound::PlayingSample &handle = playing[event.name];
+		if (event.verb == "play" || event.verb == "loop") {
+			float volume = (std::isnan(event.a) ? 1.0f : event.a);
+			float pan = (std::isnan(event.b) ? 0.0f : event.b);
+			if (event.verb == "play") handle = Sound::play(*samples[event.name], volume, pan);
+			else handle = Sound::loop(*samples[event.name], volume, pan);
+		} else if (event.verb == "stop") {
+			handle.stop(std::isnan(event.a) ? 1.0f / 60.0f : event.a);
+		} else if (event.verb == "volume") {
+			handle.set_volume(event.a, std::isnan(event.b) ? 1.0f / 60.0f : event.b);
+		} else if (event.verb == "pan") {
+			handle.set_pan(event.a, std::isnan(event.b) ? 1.0f / 60.0f : event.b);
+		} else if (event.verb == "end") {
+			break;
+		} else {
+			std::cerr << "Unknown script command '" << event.verb << "'." << std::endl;
+			return 1;
+		}
+	}
+	render_to(total_frames);
+
+	//FNV-1a hash of the output, so runs can be compared:
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (float f : out) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		for (uint32_t i = 0; i < 4; ++i) {
+			hash = (hash ^ ((bits >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+		}
+	}
+	char hash_hex[17];
+	std::snprintf(hash_hex, sizeof(hash_hex), "%016llx", (unsigned long long)hash);
+
+	double seconds = total_frames / 48000.0;
+	std::cout << "Rendered " << seconds << " seconds in " << render_ms << " ms (" << (render_ms > 0.0 ? seconds * 1000.0 / render_ms : 0.0) << "x real time)." << std::endl;
+	std::cout << "  output checksum: " << hash_hex << std::endl;
+	Sound::Stats stats = Sound::get_stats();
+	std::cout << "  per block: median " << stats.callback_us.percentile(0.5f) << " us, 99% " << stats.callback_us.percentile(0.99f) << " us; voices peak " << stats.peak_voices << ", average " << stats.average_voices << "; clipped samples: " << stats.clipped_samples << std::endl;
+	std::cout << "  limiter: " << stats.limited_frames << " frames turned down (in " << stats.limited_callbacks << " blocks), by at most " << stats.max_gain_reduction_db << " dB." << std::endl;
+
+	if (!out_filename.empty()) {
+		save_wav(out_filename, out, 2);
+		std::cout << "  wrote '" << out_filename << "'." << std::endl;
+	}
+
+	playing.clear();
+	samples.clear();
+	Sound::shutdown();
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	std::string mode = (argc > 1 ? argv[1] : "stress");
+	if (mode == "stress") return stress(argc - 2, argv + 2);
+	if (mode == "kernels") return kernels(argc - 2, argv + 2);
+	if (mode == "voices") return voices(argc - 2, argv + 2);
+	if (mode == "load") return load(argc - 2, argv + 2);
+	if (mode == "render") return render(argc - 2, argv + 2);
+	std::cerr << "Usage:\n"
+		"  " << argv[0] << " stress [seconds] [plays-per-second] [voice-limit] [block-frames]\n"
+		"  " << argv[0] << " kernels [voices] [blocks]\n"
+		"  " << argv[0] << " voices [block-frames] [seconds]\n"
+		"  " << argv[0] << " load file.opus [file.opus ...]\n"
+		"  " << argv[0] << " render [script.txt] [out.wav]\n";
+	return 1;
+}
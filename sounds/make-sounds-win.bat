@@ -1 +1,2 @@
 ..\..\nest-libs\windows\opus-tools\bin\opusenc.exe --vbr --bitrate 128 cold-dunes.wav ..\dist\cold-dunes.opus
+bake-pcm.exe death.wav ..\dist\death.pcm